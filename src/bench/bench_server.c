@@ -0,0 +1,196 @@
+/*
+ * Copyright (C) ST-Ericsson SA 2011
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * The X server functions the EXA code of the driver calls, for running it
+ * outside the server. Only what mali_exa.c, mali_blt.c and mali_hwmem.c
+ * use is provided, with the behaviour those callers rely on.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <signal.h>
+
+#include "fb.h"
+#include "mali_bench.h"
+
+ScrnInfoPtr *xf86Screens;
+
+Bool benchVerbose = FALSE;
+
+void xf86DrvMsg( int scrnIndex, MessageType type, const char *format, ... )
+{
+	va_list args;
+
+	if (!benchVerbose && type != X_ERROR && type != X_WARNING)
+		return;
+
+	fprintf(stderr, "(%s) mali(%d): ", type == X_ERROR ? "EE" : type == X_WARNING ? "WW" : "II", scrnIndex);
+	va_start(args, format);
+	vfprintf(stderr, format, args);
+	va_end(args);
+}
+
+void ErrorF( const char *format, ... )
+{
+	va_list args;
+
+	va_start(args, format);
+	vfprintf(stderr, format, args);
+	va_end(args);
+}
+
+void *exaGetPixmapDriverPrivate( PixmapPtr pPixmap )
+{
+	return pPixmap ? BENCH_PIXMAP(pPixmap)->driverPriv : NULL;
+}
+
+unsigned long exaGetPixmapPitch( PixmapPtr pPixmap )
+{
+	return pPixmap->devKind;
+}
+
+Bool miModifyPixmapHeader( PixmapPtr pPixmap, int width, int height, int depth, int bitsPerPixel, int devKind, pointer pPixData )
+{
+	if (!pPixmap)
+		return FALSE;
+
+	if (width > 0)
+		pPixmap->drawable.width = width;
+	if (height > 0)
+		pPixmap->drawable.height = height;
+	if (depth > 0)
+		pPixmap->drawable.depth = depth;
+	if (bitsPerPixel > 0)
+		pPixmap->drawable.bitsPerPixel = bitsPerPixel;
+	if (devKind > 0)
+		pPixmap->devKind = devKind;
+	if (pPixData)
+		pPixmap->devPrivate.ptr = pPixData;
+
+	return TRUE;
+}
+
+GCPtr GetScratchGC( unsigned depth, ScreenPtr pScreen )
+{
+	return calloc(1, sizeof(GC));
+}
+
+void FreeScratchGC( GCPtr pGC )
+{
+	free(pGC);
+}
+
+void ValidateGC( DrawablePtr pDraw, GCPtr pGC )
+{
+}
+
+/* GXcopy between two mapped pixmaps, in the order overlapping areas need */
+RegionPtr fbCopyArea( DrawablePtr pSrcDrawable, DrawablePtr pDstDrawable, GCPtr pGC, int xIn, int yIn, int widthSrc, int heightSrc, int xOut, int yOut )
+{
+	PixmapPtr pSrc = (PixmapPtr)pSrcDrawable;
+	PixmapPtr pDst = (PixmapPtr)pDstDrawable;
+	int cpp = pDstDrawable->bitsPerPixel / 8;
+	int y;
+
+	for (y = 0; y < heightSrc; y++)
+	{
+		int row = yOut > yIn ? heightSrc - 1 - y : y;
+		unsigned char *src = (unsigned char *)pSrc->devPrivate.ptr + (yIn + row) * pSrc->devKind + xIn * cpp;
+		unsigned char *dst = (unsigned char *)pDst->devPrivate.ptr + (yOut + row) * pDst->devKind + xOut * cpp;
+
+		memmove(dst, src, widthSrc * cpp);
+	}
+
+	return NULL;
+}
+
+void RegionDestroy( RegionPtr pReg )
+{
+	free(pReg);
+}
+
+/* The trace toggle only matters inside the server, recording is driven directly */
+Bool RegisterBlockAndWakeupHandlers( BlockHandlerProcPtr blockHandler, WakeupHandlerProcPtr wakeupHandler, pointer blockData )
+{
+	return TRUE;
+}
+
+void RemoveBlockAndWakeupHandlers( BlockHandlerProcPtr blockHandler, WakeupHandlerProcPtr wakeupHandler, pointer blockData )
+{
+}
+
+OsSigHandlerPtr OsSignal( int sig, OsSigHandlerPtr handler )
+{
+	return signal(sig, handler);
+}
+
+/* The pixman kernels fb would use, for the bpp the driver hands them */
+int pixman_fill( uint32_t *bits, int stride, int bpp, int x, int y, int width, int height, uint32_t filler )
+{
+	int cpp = bpp / 8;
+	int i, j;
+
+	if (bpp != 16 && bpp != 32)
+		return FALSE;
+
+	for (j = 0; j < height; j++)
+	{
+		unsigned char *row = (unsigned char *)(bits + (y + j) * stride) + x * cpp;
+
+		for (i = 0; i < width; i++)
+		{
+			if (cpp == 2)
+				((CARD16 *)row)[i] = filler;
+			else
+				((CARD32 *)row)[i] = filler;
+		}
+	}
+
+	return TRUE;
+}
+
+int pixman_blt( uint32_t *src_bits, uint32_t *dst_bits, int src_stride, int dst_stride, int src_bpp, int dst_bpp,
+		int src_x, int src_y, int dest_x, int dest_y, int width, int height )
+{
+	int cpp = src_bpp / 8;
+	int j;
+
+	if (src_bpp != dst_bpp || (src_bpp != 16 && src_bpp != 32))
+		return FALSE;
+
+	for (j = 0; j < height; j++)
+	{
+		int row = dest_y > src_y ? height - 1 - j : j;
+
+		memmove((unsigned char *)(dst_bits + (dest_y + row) * dst_stride) + dest_x * cpp,
+			(unsigned char *)(src_bits + (src_y + row) * src_stride) + src_x * cpp, width * cpp);
+	}
+
+	return TRUE;
+}
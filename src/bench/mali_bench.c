@@ -0,0 +1,782 @@
+/*
+ * Copyright (C) ST-Ericsson SA 2011
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * EXA microbenchmark.
+ *
+ * Sets the driver up with maliSetupExa and calls the hooks it installs
+ * the way EXA does, without an X server. The blitter is whatever the
+ * program was linked against: libblt_hw and /dev/hwmem on the device, or
+ * the CPU emulation of --enable-blt-emulation. With --cpu, every case is
+ * also run with plain C loops, the work fb does when a hook declines.
+ *
+ * Each case prints one JSON object per line:
+ *
+ *   {"op":"copy","pattern":"scroll-up","width":256,"height":256,"bpp":16,
+ *    "path":"exa","backend":"blt_hw","blt_thread":false,"blt_channels":2,
+ *    "dispatch":false,"accelerated":true,
+ *    "iterations":200,
+ *    "ops_per_sec":...,"mpix_per_sec":...,
+ *    "latency_us":{"p50":...,"p90":...,"p99":...,"max":...}}
+ *
+ * Throughput comes from back to back operations with one wait at the end,
+ * latencies from operations waited for one at a time. Cases a hook
+ * declines are reported with "accelerated":false and no figures.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+
+#include "picturestr.h"
+#include "mali_bench.h"
+#include "mali_def.h"
+#include "mali_exa.h"
+#include "mali_fbdev.h"
+
+#ifdef MALI_BLT_EMULATION
+#define BENCH_BACKEND "emulated"
+#else
+#define BENCH_BACKEND "blt_hw"
+#endif
+
+/* Runs before measuring, they also warm up the hwmem pool */
+#define BENCH_WARMUP 5
+
+#define BENCH_MAX_VALUES 16
+
+#define BENCH_ALIGN( value, base ) (((value) + ((base) - 1)) & ~((base) - 1))
+
+enum
+{
+	BENCH_SOLID,
+	BENCH_COPY,
+	BENCH_COMPOSITE,
+	BENCH_UPLOAD,
+	BENCH_DOWNLOAD,
+	BENCH_NUM_OPS
+};
+
+static const char *bench_op_names[BENCH_NUM_OPS] = { "solid", "copy", "composite", "upload", "download" };
+
+/*
+ * Per operation variants. Copies move the destination by an eighth of
+ * the size against the source, inside one pixmap unless disjoint.
+ */
+typedef struct
+{
+	const char *name;
+	int dx, dy;
+	int op;
+	int alpha;
+} BenchPattern;
+
+static const BenchPattern bench_solid_patterns[] = {
+	{ "rect" },
+	{ "spans" },
+	{ NULL }
+};
+
+static const BenchPattern bench_copy_patterns[] = {
+	{ "disjoint" },
+	{ "scroll-up", 0, -1 },
+	{ "scroll-down", 0, 1 },
+	{ "scroll-left", -1, 0 },
+	{ "scroll-right", 1, 0 },
+	{ NULL }
+};
+
+static const BenchPattern bench_composite_patterns[] = {
+	{ "src", 0, 0, PictOpSrc, 0xff },
+	{ "over", 0, 0, PictOpOver, 0xff },
+	{ "over-alpha", 0, 0, PictOpOver, 0x80 },
+	{ NULL }
+};
+
+static const BenchPattern bench_transfer_patterns[] = {
+	{ "full" },
+	{ NULL }
+};
+
+static const BenchPattern *bench_patterns[BENCH_NUM_OPS] = {
+	bench_solid_patterns,
+	bench_copy_patterns,
+	bench_composite_patterns,
+	bench_transfer_patterns,
+	bench_transfer_patterns
+};
+
+typedef struct
+{
+	int op;
+	const BenchPattern *pattern;
+	int width, height, bpp;
+
+	/* rectangles of the operation */
+	int srcX, srcY, dstX, dstY, w, h;
+
+	PixmapPtr pSrc;
+	PixmapPtr pDst;
+	PictureRec srcPict, maskPict, dstPict;
+	SourcePict maskSource;
+
+	/* client memory for transfers, and the images of the CPU path */
+	unsigned char *host;
+	unsigned char *cpuSrc;
+	unsigned char *cpuDst;
+	int pitch;
+} BenchCase;
+
+static ScreenRec benchScreen;
+static ScrnInfoRec benchScrn;
+static MaliRec benchMali;
+static ScrnInfoPtr benchScreens[1];
+static ExaDriverRec benchExa;
+
+/* never the data of a pixmap, see maliModifyPixmapHeader */
+static unsigned char benchFramebuffer;
+
+static int bench_iterations = 200;
+static Bool bench_cpu = FALSE;
+static Bool bench_blt_thread = FALSE;
+static int bench_blt_inflight = MALI_BLT_MAX_INFLIGHT;
+static int bench_blt_channels = MALI_BLT_CHANNELS_DEFAULT;
+static Bool bench_dispatch = FALSE;
+static const char *bench_dispatch_profile = NULL;
+
+static double benchNow( void )
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int benchParseList( const char *arg, int *values )
+{
+	int n = 0;
+
+	while (*arg && n < BENCH_MAX_VALUES)
+	{
+		char *end;
+
+		values[n] = strtol(arg, &end, 0);
+		if (end == arg || values[n] <= 0)
+			return 0;
+		n++;
+		arg = *end == ',' ? end + 1 : end;
+	}
+
+	return n;
+}
+
+static Bool benchInit( int sysmem_area, const char *trace_file )
+{
+	benchScreens[0] = &benchScrn;
+	xf86Screens = benchScreens;
+
+	benchScreen.myNum = 0;
+	benchScrn.scrnIndex = 0;
+	benchScrn.pScreen = &benchScreen;
+	benchScrn.driverPrivate = &benchMali;
+
+	benchMali.fb_lcd_fd = -1;
+	benchMali.hwmem_pool_size = MALI_HWMEM_POOL_SIZE_DEFAULT;
+	benchMali.sysmem_pixmap_area = sysmem_area;
+	benchMali.blt_thread = bench_blt_thread;
+	benchMali.blt_inflight = bench_blt_inflight;
+	benchMali.blt_channels = bench_blt_channels;
+	benchMali.dispatch = bench_dispatch;
+	benchMali.dispatch_profile = bench_dispatch_profile;
+	benchMali.blt_video_channel = TRUE;
+	benchMali.blt_prio[MALI_BLT_CLASS_XV] = MALI_BLT_PRIO_XV_DEFAULT;
+	benchMali.blt_prio[MALI_BLT_CLASS_DRI2] = MALI_BLT_PRIO_DRI2_DEFAULT;
+	benchMali.blt_prio[MALI_BLT_CLASS_FILL] = MALI_BLT_PRIO_FILL_DEFAULT;
+	benchMali.blt_prio[MALI_BLT_CLASS_COPY] = MALI_BLT_PRIO_COPY_DEFAULT;
+	benchMali.blt_prio[MALI_BLT_CLASS_UPLOAD] = MALI_BLT_PRIO_UPLOAD_DEFAULT;
+	benchMali.hwmem_fd = maliHwmemDevOpen();
+	if (benchMali.hwmem_fd < 0)
+	{
+		fprintf(stderr, "mali_bench: failed to open hwmem\n");
+		return FALSE;
+	}
+
+	if (trace_file)
+		maliTraceInit(&benchMali.trace, 0, MALI_TRACE_EVENTS_DEFAULT, trace_file, TRUE);
+
+	if (!maliSetupExa(&benchScreen, &benchExa, 0, 0, &benchFramebuffer))
+	{
+		fprintf(stderr, "mali_bench: failed to set up EXA\n");
+		maliTraceFini(&benchMali.trace);
+		maliHwmemDevClose(benchMali.hwmem_fd);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static void benchFini( void )
+{
+	if (benchVerbose)
+	{
+		char stats[MALI_STATS_SIZE];
+
+		maliExaPrintStats(stats, sizeof(stats));
+		fputs(stats, stderr);
+	}
+
+	maliCloseExa(&benchScreen);
+	maliTraceFini(&benchMali.trace);
+	maliHwmemDevClose(benchMali.hwmem_fd);
+}
+
+static void benchDestroyPixmap( PixmapPtr pPixmap )
+{
+	if (!pPixmap)
+		return;
+
+	benchExa.DestroyPixmap(&benchScreen, BENCH_PIXMAP(pPixmap)->driverPriv);
+	free(pPixmap);
+}
+
+/* What exaCreatePixmap does in driver mode, filled with a byte pattern */
+static PixmapPtr benchCreatePixmap( int width, int height, int bpp, int seed )
+{
+	BenchPixmapPtr pBench = calloc(1, sizeof(*pBench));
+	PixmapPtr pPixmap;
+	unsigned char *data;
+	int pitch, i;
+
+	if (!pBench)
+		return NULL;
+
+	pPixmap = &pBench->pixmap;
+	pPixmap->drawable.type = DRAWABLE_PIXMAP;
+	pPixmap->drawable.pScreen = &benchScreen;
+	pPixmap->refcnt = 1;
+
+	pitch = BENCH_ALIGN((width * bpp + 7) / 8, 8);
+	pBench->driverPriv = benchExa.CreatePixmap(&benchScreen, pitch * height, 0);
+	if (!pBench->driverPriv ||
+	    !benchExa.ModifyPixmapHeader(pPixmap, width, height, bpp == 32 ? 24 : bpp, bpp, pitch, NULL) ||
+	    !benchExa.PrepareAccess(pPixmap, EXA_PREPARE_DEST))
+	{
+		if (pBench->driverPriv)
+			benchExa.DestroyPixmap(&benchScreen, pBench->driverPriv);
+		free(pBench);
+		return NULL;
+	}
+
+	data = pPixmap->devPrivate.ptr;
+	for (i = 0; i < pPixmap->devKind * height; i++)
+		data[i] = i * 31 + seed;
+	benchExa.FinishAccess(pPixmap, EXA_PREPARE_DEST);
+
+	return pPixmap;
+}
+
+static CARD32 benchPictFormat( int bpp )
+{
+	switch (bpp)
+	{
+		case 32:
+			return PICT_a8r8g8b8;
+		case 16:
+			return PICT_r5g6b5;
+		default:
+			return PICT_a8;
+	}
+}
+
+static void benchCaseFini( BenchCase *c )
+{
+	if (c->pSrc != c->pDst)
+		benchDestroyPixmap(c->pSrc);
+	benchDestroyPixmap(c->pDst);
+	free(c->host);
+	free(c->cpuSrc);
+	free(c->cpuDst);
+}
+
+static Bool benchCaseInit( BenchCase *c )
+{
+	const BenchPattern *pattern = c->pattern;
+	int cpp = c->bpp / 8;
+	int step = max(1, min(c->width, c->height) / 8);
+	int i;
+
+	c->w = c->width - abs(pattern->dx) * step;
+	c->h = c->height - abs(pattern->dy) * step;
+	c->srcX = pattern->dx < 0 ? step : 0;
+	c->srcY = pattern->dy < 0 ? step : 0;
+	c->dstX = pattern->dx > 0 ? step : 0;
+	c->dstY = pattern->dy > 0 ? step : 0;
+	c->pitch = BENCH_ALIGN(c->width * cpp, 8);
+
+	c->pDst = benchCreatePixmap(c->width, c->height, c->bpp, 1);
+	if (!c->pDst)
+		return FALSE;
+
+	switch (c->op)
+	{
+		case BENCH_COPY:
+			if (pattern->dx || pattern->dy)
+			{
+				c->pSrc = c->pDst;
+				break;
+			}
+			/* fall through */
+		case BENCH_DOWNLOAD:
+			c->pSrc = benchCreatePixmap(c->width, c->height, c->bpp, 2);
+			break;
+		case BENCH_COMPOSITE:
+			c->pSrc = benchCreatePixmap(c->width, c->height, 32, 2);
+			break;
+		default:
+			break;
+	}
+
+	if ((c->op == BENCH_COPY || c->op == BENCH_DOWNLOAD || c->op == BENCH_COMPOSITE) && !c->pSrc)
+		return FALSE;
+
+	if (c->op == BENCH_COMPOSITE)
+	{
+		c->srcPict.pDrawable = &c->pSrc->drawable;
+		c->srcPict.format = PICT_a8r8g8b8;
+		c->dstPict.pDrawable = &c->pDst->drawable;
+		c->dstPict.format = benchPictFormat(c->bpp);
+		c->maskSource.type = SourcePictTypeSolidFill;
+		c->maskSource.solidFill.color = (CARD32)pattern->alpha << 24;
+		c->maskPict.pSourcePict = &c->maskSource;
+	}
+
+	c->host = malloc(c->pitch * c->height);
+	c->cpuSrc = malloc(BENCH_ALIGN(c->width * 4, 8) * c->height);
+	c->cpuDst = malloc(c->pitch * c->height);
+	if (!c->host || !c->cpuSrc || !c->cpuDst)
+		return FALSE;
+
+	for (i = 0; i < c->pitch * c->height; i++)
+		c->host[i] = c->cpuDst[i] = i * 31 + 3;
+	for (i = 0; i < BENCH_ALIGN(c->width * 4, 8) * c->height; i++)
+		c->cpuSrc[i] = i * 31 + 2;
+
+	return TRUE;
+}
+
+/* One operation through the hooks, FALSE if the driver declines it */
+static Bool benchRunExa( BenchCase *c )
+{
+	int i, xdir, ydir;
+
+	switch (c->op)
+	{
+		case BENCH_SOLID:
+			if (!benchExa.PrepareSolid(c->pDst, GXcopy, ~0, 0x12345678))
+				return FALSE;
+			if (c->pattern == &bench_solid_patterns[0])
+				benchExa.Solid(c->pDst, 0, 0, c->w, c->h);
+			else
+				for (i = 0; i < c->h; i++)
+					benchExa.Solid(c->pDst, 0, i, c->w, i + 1);
+			benchExa.DoneSolid(c->pDst);
+			return TRUE;
+
+		case BENCH_COPY:
+			xdir = c->srcX < c->dstX ? -1 : 1;
+			ydir = c->srcY < c->dstY ? -1 : 1;
+			if (!benchExa.PrepareCopy(c->pSrc, c->pDst, xdir, ydir, GXcopy, ~0))
+				return FALSE;
+			benchExa.Copy(c->pDst, c->srcX, c->srcY, c->dstX, c->dstY, c->w, c->h);
+			benchExa.DoneCopy(c->pDst);
+			return TRUE;
+
+		case BENCH_COMPOSITE:
+		{
+			PicturePtr pMask = c->pattern->alpha < 0xff ? &c->maskPict : NULL;
+
+			if (!benchExa.CheckComposite(c->pattern->op, &c->srcPict, pMask, &c->dstPict) ||
+			    !benchExa.PrepareComposite(c->pattern->op, &c->srcPict, pMask, &c->dstPict, c->pSrc, NULL, c->pDst))
+				return FALSE;
+			benchExa.Composite(c->pDst, 0, 0, 0, 0, 0, 0, c->w, c->h);
+			benchExa.DoneComposite(c->pDst);
+			return TRUE;
+		}
+
+		case BENCH_UPLOAD:
+			return benchExa.UploadToScreen(c->pDst, 0, 0, c->w, c->h, (char *)c->host, c->pitch);
+
+		case BENCH_DOWNLOAD:
+			return benchExa.DownloadFromScreen(c->pSrc, 0, 0, c->w, c->h, (char *)c->host, c->pitch);
+	}
+
+	return FALSE;
+}
+
+/* Wait until the blitter is done with the pixmaps of the case */
+static void benchSyncExa( BenchCase *c )
+{
+	if (c->pSrc && c->pSrc != c->pDst)
+		maliPixmapWaitIdle(c->pSrc);
+	if (c->pDst)
+		maliPixmapWaitIdle(c->pDst);
+}
+
+static void benchFillCpu( unsigned char *row, int pitch, int bpp, int w, int h, CARD32 color )
+{
+	int x, y;
+
+	for (y = 0; y < h; y++, row += pitch)
+	{
+		if (bpp == 32)
+			for (x = 0; x < w; x++)
+				((CARD32 *)row)[x] = color;
+		else if (bpp == 16)
+			for (x = 0; x < w; x++)
+				((CARD16 *)row)[x] = color;
+		else
+			memset(row, color, w);
+	}
+}
+
+/* Premultiplied Over of a8r8g8b8 onto a8r8g8b8 */
+static void benchOverCpu( const unsigned char *srow, int spitch, unsigned char *drow, int dpitch, int w, int h, int alpha )
+{
+	int x, y, i;
+
+	for (y = 0; y < h; y++, srow += spitch, drow += dpitch)
+	{
+		const CARD32 *src = (const CARD32 *)srow;
+		CARD32 *dst = (CARD32 *)drow;
+
+		for (x = 0; x < w; x++)
+		{
+			CARD32 s = src[x], d = dst[x], r = 0;
+			int sa = ((s >> 24) * alpha + 127) / 255;
+
+			for (i = 0; i < 32; i += 8)
+			{
+				int sc = (((s >> i) & 0xff) * alpha + 127) / 255;
+				int dc = (d >> i) & 0xff;
+
+				r |= (CARD32)(sc + (dc * (255 - sa) + 127) / 255) << i;
+			}
+			dst[x] = r;
+		}
+	}
+}
+
+/*
+ * The same operation with C loops. Composites onto anything but 32 bpp
+ * need a format conversion fb would get from pixman, they are skipped.
+ */
+static Bool benchRunCpu( BenchCase *c )
+{
+	int cpp = c->bpp / 8;
+	int spitch = BENCH_ALIGN(c->width * 4, 8);
+	unsigned char *src, *dst;
+	int i;
+
+	switch (c->op)
+	{
+		case BENCH_SOLID:
+			if (c->pattern == &bench_solid_patterns[0])
+				benchFillCpu(c->cpuDst, c->pitch, c->bpp, c->w, c->h, 0x12345678);
+			else
+				for (i = 0; i < c->h; i++)
+					benchFillCpu(c->cpuDst + i * c->pitch, c->pitch, c->bpp, c->w, 1, 0x12345678);
+			return TRUE;
+
+		case BENCH_COPY:
+			src = (c->pattern->dx || c->pattern->dy ? c->cpuDst : c->cpuSrc) + c->srcY * c->pitch + c->srcX * cpp;
+			dst = c->cpuDst + c->dstY * c->pitch + c->dstX * cpp;
+			for (i = 0; i < c->h; i++)
+			{
+				int row = c->dstY > c->srcY ? c->h - 1 - i : i;
+
+				memmove(dst + row * c->pitch, src + row * c->pitch, c->w * cpp);
+			}
+			return TRUE;
+
+		case BENCH_COMPOSITE:
+			if (c->bpp != 32)
+				return FALSE;
+			if (c->pattern->op == PictOpSrc)
+				for (i = 0; i < c->h; i++)
+					memcpy(c->cpuDst + i * c->pitch, c->cpuSrc + i * spitch, c->w * 4);
+			else
+				benchOverCpu(c->cpuSrc, spitch, c->cpuDst, c->pitch, c->w, c->h, c->pattern->alpha);
+			return TRUE;
+
+		case BENCH_UPLOAD:
+			for (i = 0; i < c->h; i++)
+				memcpy(c->cpuDst + i * c->pitch, c->host + i * c->pitch, c->w * cpp);
+			return TRUE;
+
+		case BENCH_DOWNLOAD:
+			for (i = 0; i < c->h; i++)
+				memcpy(c->host + i * c->pitch, c->cpuDst + i * c->pitch, c->w * cpp);
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+static int benchCompareDouble( const void *a, const void *b )
+{
+	double da = *(const double *)a, db = *(const double *)b;
+
+	return da < db ? -1 : da > db;
+}
+
+static void benchReportCase( BenchCase *c, const char *path )
+{
+	printf("{\"op\":\"%s\",\"pattern\":\"%s\",\"width\":%d,\"height\":%d,\"bpp\":%d,\"path\":\"%s\",\"backend\":\"%s\",\"blt_thread\":%s,\"blt_channels\":%d,\"dispatch\":%s",
+	       bench_op_names[c->op], c->pattern->name, c->width, c->height, c->bpp, path, BENCH_BACKEND,
+	       benchMali.blt_thread ? "true" : "false", benchMali.blt_channels, benchMali.dispatch ? "true" : "false");
+}
+
+static void benchMeasure( BenchCase *c, Bool exa )
+{
+	Bool (*run)( BenchCase *c ) = exa ? benchRunExa : benchRunCpu;
+	double *latency, start, total;
+	int n = bench_iterations, i;
+
+	for (i = 0; i < BENCH_WARMUP; i++)
+	{
+		if (!run(c))
+		{
+			if (exa)
+			{
+				benchReportCase(c, "exa");
+				printf(",\"accelerated\":false}\n");
+			}
+			return;
+		}
+	}
+	if (exa)
+		benchSyncExa(c);
+
+	latency = malloc(n * sizeof(*latency));
+	if (!latency)
+		return;
+
+	start = benchNow();
+	for (i = 0; i < n; i++)
+		run(c);
+	if (exa)
+		benchSyncExa(c);
+	total = benchNow() - start;
+
+	for (i = 0; i < n; i++)
+	{
+		start = benchNow();
+		run(c);
+		if (exa)
+			benchSyncExa(c);
+		latency[i] = (benchNow() - start) * 1e6;
+	}
+	qsort(latency, n, sizeof(*latency), benchCompareDouble);
+
+	benchReportCase(c, exa ? "exa" : "cpu");
+	if (exa)
+		printf(",\"accelerated\":true");
+	printf(",\"iterations\":%d,\"ops_per_sec\":%.1f,\"mpix_per_sec\":%.2f"
+	       ",\"latency_us\":{\"p50\":%.1f,\"p90\":%.1f,\"p99\":%.1f,\"max\":%.1f}}\n",
+	       n, n / total, (double)n * c->w * c->h / total / 1e6,
+	       latency[(n - 1) * 50 / 100], latency[(n - 1) * 90 / 100],
+	       latency[(n - 1) * 99 / 100], latency[n - 1]);
+	fflush(stdout);
+
+	free(latency);
+}
+
+static void benchUsage( void )
+{
+	fprintf(stderr,
+		"usage: mali_bench [options]\n"
+		"  --ops=LIST          solid,copy,composite,upload,download (default: all)\n"
+		"  --sizes=LIST        square sizes in pixels (default: 16,64,256,1024)\n"
+		"  --bpp=LIST          8, 16 and/or 32 (default: 16,32)\n"
+		"  --iterations=N      operations per measurement (default: 200)\n"
+		"  --sysmem-area=N     the SYSMEM_PIXMAP_AREA option (default: %d)\n"
+		"  --cpu               also run every case with C loops\n"
+		"  --blt-thread        submit blits from a separate thread\n"
+		"  --inflight=N        the BLT_INFLIGHT option (default: %d)\n"
+		"  --channels=N        the BLT_CHANNELS option (default: %d)\n"
+		"  --dispatch          let the cost model hand small operations to the CPU\n"
+		"  --dispatch-profile=FILE  the DISPATCH_PROFILE option\n"
+		"  --trace=FILE        write the last %d driver events to FILE\n"
+		"  --verbose           show all driver messages\n",
+		MALI_SYSMEM_PIXMAP_AREA_DEFAULT, MALI_BLT_MAX_INFLIGHT, MALI_BLT_CHANNELS_DEFAULT, MALI_TRACE_EVENTS_DEFAULT);
+}
+
+int main( int argc, char **argv )
+{
+	static const struct option options[] = {
+		{ "ops", required_argument, NULL, 'o' },
+		{ "sizes", required_argument, NULL, 's' },
+		{ "bpp", required_argument, NULL, 'b' },
+		{ "iterations", required_argument, NULL, 'i' },
+		{ "sysmem-area", required_argument, NULL, 'a' },
+		{ "cpu", no_argument, NULL, 'c' },
+		{ "blt-thread", no_argument, NULL, 'T' },
+		{ "inflight", required_argument, NULL, 'I' },
+		{ "channels", required_argument, NULL, 'C' },
+		{ "dispatch", no_argument, NULL, 'd' },
+		{ "dispatch-profile", required_argument, NULL, 'P' },
+		{ "trace", required_argument, NULL, 't' },
+		{ "verbose", no_argument, NULL, 'v' },
+		{ "help", no_argument, NULL, 'h' },
+		{ NULL, 0, NULL, 0 }
+	};
+	Bool ops[BENCH_NUM_OPS] = { TRUE, TRUE, TRUE, TRUE, TRUE };
+	int sizes[BENCH_MAX_VALUES] = { 16, 64, 256, 1024 };
+	int bpps[BENCH_MAX_VALUES] = { 16, 32 };
+	int num_sizes = 4, num_bpps = 2;
+	int sysmem_area = MALI_SYSMEM_PIXMAP_AREA_DEFAULT;
+	const char *trace_file = NULL;
+	int opt, op, s, b, i;
+	char *list, *name;
+
+	while ((opt = getopt_long(argc, argv, "", options, NULL)) != -1)
+	{
+		switch (opt)
+		{
+			case 'o':
+				memset(ops, 0, sizeof(ops));
+				list = strdup(optarg);
+				for (name = strtok(list, ","); name; name = strtok(NULL, ","))
+				{
+					for (op = 0; op < BENCH_NUM_OPS; op++)
+						if (!strcmp(name, bench_op_names[op]))
+							break;
+					if (op == BENCH_NUM_OPS)
+					{
+						fprintf(stderr, "mali_bench: unknown operation %s\n", name);
+						return 1;
+					}
+					ops[op] = TRUE;
+				}
+				free(list);
+				break;
+			case 's':
+				num_sizes = benchParseList(optarg, sizes);
+				break;
+			case 'b':
+				num_bpps = benchParseList(optarg, bpps);
+				for (i = 0; i < num_bpps; i++)
+					if (bpps[i] != 8 && bpps[i] != 16 && bpps[i] != 32)
+						num_bpps = 0;
+				break;
+			case 'i':
+				bench_iterations = atoi(optarg);
+				break;
+			case 'a':
+				sysmem_area = atoi(optarg);
+				break;
+			case 'c':
+				bench_cpu = TRUE;
+				break;
+			case 'T':
+				bench_blt_thread = TRUE;
+				break;
+			case 'I':
+				bench_blt_inflight = atoi(optarg);
+				break;
+			case 'C':
+				bench_blt_channels = atoi(optarg);
+				break;
+			case 'd':
+				bench_dispatch = TRUE;
+				break;
+			case 'P':
+				bench_dispatch_profile = optarg;
+				break;
+			case 't':
+				trace_file = optarg;
+				break;
+			case 'v':
+				benchVerbose = TRUE;
+				break;
+			default:
+				benchUsage();
+				return opt == 'h' ? 0 : 1;
+		}
+	}
+
+	if (optind < argc || !num_sizes || !num_bpps || bench_iterations <= 0 || sysmem_area < 0 ||
+	    bench_blt_inflight < 1 || bench_blt_inflight > MALI_BLT_MAX_INFLIGHT ||
+	    bench_blt_channels < 1 || bench_blt_channels > MALI_BLT_MAX_CHANNELS)
+	{
+		benchUsage();
+		return 1;
+	}
+
+	if (!benchInit(sysmem_area, trace_file))
+		return 1;
+
+	for (op = 0; op < BENCH_NUM_OPS; op++)
+	{
+		const BenchPattern *pattern;
+
+		if (!ops[op])
+			continue;
+
+		for (pattern = bench_patterns[op]; pattern->name; pattern++)
+			for (s = 0; s < num_sizes; s++)
+				for (b = 0; b < num_bpps; b++)
+				{
+					BenchCase c;
+
+					memset(&c, 0, sizeof(c));
+					c.op = op;
+					c.pattern = pattern;
+					c.width = c.height = sizes[s];
+					c.bpp = bpps[b];
+
+					if (!benchCaseInit(&c))
+					{
+						fprintf(stderr, "mali_bench: failed to set up %s %s %dx%d at %d bpp\n",
+							bench_op_names[op], pattern->name, c.width, c.height, c.bpp);
+						benchCaseFini(&c);
+						continue;
+					}
+
+					benchMeasure(&c, TRUE);
+					if (bench_cpu)
+						benchMeasure(&c, FALSE);
+
+					benchCaseFini(&c);
+				}
+	}
+
+	benchFini();
+
+	return 0;
+}
@@ -0,0 +1,44 @@
+/*
+ * Copyright (C) ST-Ericsson SA 2011
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef _MALI_BENCH_H_
+#define _MALI_BENCH_H_
+
+#include "xf86.h"
+#include "exa.h"
+
+/*
+ * Pixmaps created by the benchmark. EXA keeps the driver private in its
+ * own pixmap private, here it simply follows the pixmap.
+ */
+typedef struct
+{
+	PixmapRec pixmap;
+	void *driverPriv;
+} BenchPixmapRec, *BenchPixmapPtr;
+
+#define BENCH_PIXMAP( p ) ((BenchPixmapPtr)(p))
+
+/* Print driver messages of every severity, not only errors */
+extern Bool benchVerbose;
+
+#endif /* _MALI_BENCH_H_ */
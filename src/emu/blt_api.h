@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) ST-Ericsson SA 2011
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * The part of the libblt_hw API used by the driver, for the emulation
+ * build. Only the names have to match the real header; the values are
+ * private to blt_emu.c.
+ */
+
+#ifndef _BLT_API_H_
+#define _BLT_API_H_
+
+#include <stdint.h>
+
+enum blt_fmt {
+	BLT_FMT_UNUSED = 0,
+	BLT_FMT_16_BIT_ARGB4444,
+	BLT_FMT_16_BIT_ARGB1555,
+	BLT_FMT_16_BIT_RGB565,
+	BLT_FMT_24_BIT_RGB888,
+	BLT_FMT_32_BIT_ARGB8888,
+	BLT_FMT_32_BIT_ABGR8888,
+	BLT_FMT_YUV420_PACKED_PLANAR,
+	BLT_FMT_YUV420_PACKED_SEMIPLANAR_MB_STE,
+	BLT_FMT_CB_Y_CR_Y,
+	BLT_FMT_Y_CB_Y_CR,
+};
+
+enum blt_ptr_type {
+	BLT_PTR_NONE = 0,
+	BLT_PTR_VIRTUAL,
+	BLT_PTR_PHYSICAL,
+	BLT_PTR_FD_OFFSET,
+	BLT_PTR_HWMEM_BUF_NAME_OFFSET,
+};
+
+enum blt_flag {
+	BLT_FLAG_ASYNCH                  = 0x1,
+	BLT_FLAG_DRY_RUN                 = 0x2,
+	BLT_FLAG_PER_PIXEL_ALPHA_BLEND   = 0x4,
+	BLT_FLAG_GLOBAL_ALPHA_BLEND      = 0x8,
+	BLT_FLAG_SOURCE_COLOR_KEY        = 0x10,
+	BLT_FLAG_SOURCE_FILL             = 0x20,
+	BLT_FLAG_SOURCE_FILL_RAW         = 0x40,
+	BLT_FLAG_DEST_COLOR_KEY          = 0x80,
+	BLT_FLAG_SRC_IS_NOT_PREMULT      = 0x100,
+	BLT_FLAG_DITHER                  = 0x200,
+	BLT_FLAG_BLUR                    = 0x400,
+	BLT_FLAG_SOURCE_MASK             = 0x800,
+	BLT_FLAG_DESTINATION_CLIP        = 0x1000,
+	BLT_FLAG_INHERIT_PRIO            = 0x2000,
+	BLT_FLAG_SRC_NO_CACHE_FLUSH      = 0x4000,
+	BLT_FLAG_SRC_MASK_NO_CACHE_FLUSH = 0x8000,
+	BLT_FLAG_DST_NO_CACHE_FLUSH      = 0x10000,
+};
+
+enum blt_transform {
+	BLT_TRANSFORM_NONE = 0,
+	BLT_TRANSFORM_FLIP_V = 1,
+	BLT_TRANSFORM_FLIP_H = 2,
+	BLT_TRANSFORM_CCW_ROT_180 = 3,
+	BLT_TRANSFORM_CCW_ROT_90 = 4,
+	BLT_TRANSFORM_CCW_ROT_270 = 7,
+};
+
+struct blt_buf {
+	enum blt_ptr_type type;
+	int hwmem_buf_name;
+	int fd;
+	uint32_t offset;
+	uint32_t len;
+	void *bits;
+};
+
+struct blt_img {
+	enum blt_fmt fmt;
+	struct blt_buf buf;
+	int32_t width;
+	int32_t height;
+	uint32_t pitch;
+};
+
+struct blt_rect {
+	int32_t x;
+	int32_t y;
+	int32_t width;
+	int32_t height;
+};
+
+struct blt_req {
+	uint32_t size;
+	enum blt_flag flags;
+	enum blt_transform transform;
+	int32_t prio;
+	uint32_t src_color;
+	struct blt_img src_img;
+	struct blt_img src_mask;
+	struct blt_rect src_rect;
+	struct blt_img dst_img;
+	struct blt_rect dst_rect;
+	struct blt_rect dst_clip_rect;
+	uint8_t global_alpha;
+	uint32_t report1;
+	uint32_t report2;
+};
+
+int blt_open(void);
+void blt_close(int blt);
+int blt_request(int blt, struct blt_req *req);
+int blt_synch(int blt, int request_id);
+
+#endif /* _BLT_API_H_ */
@@ -0,0 +1,440 @@
+/*
+ * Copyright (C) ST-Ericsson SA 2011
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+/*
+ * libblt_hw emulation on the CPU.
+ *
+ * Implements the subset of blt_req the driver issues: raw and ARGB fills,
+ * copies with format conversion, nearest neighbour scaling, destination
+ * clipping, premultiplied per-pixel and global alpha blending, and YUV to
+ * RGB conversion from planar I420, UYVY and YUY2 sources. Requests run
+ * to completion inside blt_request, in submission order, so blt_synch has
+ * nothing to wait for. Anything else fails with EINVAL rather than
+ * producing something the hardware would not.
+ *
+ * Results are exact in the sense of being fully defined: channels widen
+ * by bit replication, blending rounds (a * b + 127) / 255, YUV uses the
+ * BT.601 integer equations and scaling samples the source pixel under the
+ * centre of each destination pixel in 16.16 fixed point.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <blt_api.h>
+
+#include "mali_emu.h"
+
+#define EMU_MAX_HANDLES 16
+
+#define EMU_MIN(a, b) ((a) < (b) ? (a) : (b))
+#define EMU_MAX(a, b) ((a) > (b) ? (a) : (b))
+
+typedef struct
+{
+	enum blt_fmt fmt;
+	unsigned char *bits;
+	int width;
+	int height;
+	int pitch;
+} EmuImage;
+
+static int emu_open[EMU_MAX_HANDLES];
+static int emu_last_request[EMU_MAX_HANDLES];
+
+static int emuBpp( enum blt_fmt fmt )
+{
+	switch (fmt)
+	{
+	case BLT_FMT_16_BIT_ARGB4444:
+	case BLT_FMT_16_BIT_ARGB1555:
+	case BLT_FMT_16_BIT_RGB565:
+	case BLT_FMT_CB_Y_CR_Y:
+	case BLT_FMT_Y_CB_Y_CR:
+		return 16;
+	case BLT_FMT_24_BIT_RGB888:
+		return 24;
+	case BLT_FMT_32_BIT_ARGB8888:
+	case BLT_FMT_32_BIT_ABGR8888:
+		return 32;
+	case BLT_FMT_YUV420_PACKED_PLANAR:
+		return 8;	/* luma plane */
+	default:
+		return 0;
+	}
+}
+
+static int emuIsRgb( enum blt_fmt fmt )
+{
+	return fmt != BLT_FMT_YUV420_PACKED_PLANAR && fmt != BLT_FMT_CB_Y_CR_Y && fmt != BLT_FMT_Y_CB_Y_CR;
+}
+
+/* Resolve the buffer of an image and check the image fits inside it */
+static int emuSetupImage( const struct blt_img *img, EmuImage *out )
+{
+	unsigned long size, need;
+	unsigned char *base;
+	int bpp = emuBpp(img->fmt);
+
+	if (!bpp || img->width <= 0 || img->height <= 0)
+		return 0;
+
+	switch (img->buf.type)
+	{
+	case BLT_PTR_HWMEM_BUF_NAME_OFFSET:
+		base = maliEmuHwmemLookup(img->buf.hwmem_buf_name, &size);
+		if (!base || img->buf.offset >= size)
+			return 0;
+		base += img->buf.offset;
+		size -= img->buf.offset;
+		break;
+	case BLT_PTR_VIRTUAL:
+		if (!img->buf.bits)
+			return 0;
+		base = (unsigned char *)img->buf.bits + img->buf.offset;
+		size = img->buf.len ? img->buf.len : ~0UL;
+		break;
+	default:
+		/* physical addresses and fds have no meaning here */
+		return 0;
+	}
+
+	out->fmt = img->fmt;
+	out->bits = base;
+	out->width = img->width;
+	out->height = img->height;
+	out->pitch = img->pitch ? (int)img->pitch : (img->width * bpp + 7) / 8;
+
+	need = (unsigned long)out->pitch * out->height;
+	if (img->fmt == BLT_FMT_YUV420_PACKED_PLANAR)
+		need += 2 * (unsigned long)(out->pitch / 2) * (out->height / 2);
+
+	return need <= size;
+}
+
+static uint32_t emuExpand( uint32_t v, int bits )
+{
+	v <<= 8 - bits;
+	return v | (v >> bits);
+}
+
+static uint8_t emuClamp( int v )
+{
+	return v < 0 ? 0 : v > 255 ? 255 : v;
+}
+
+static uint32_t emuYuvToArgb( int y, int u, int v )
+{
+	int c = y - 16, d = u - 128, e = v - 128;
+
+	return 0xff000000 |
+	       emuClamp((298 * c + 409 * e + 128) >> 8) << 16 |
+	       emuClamp((298 * c - 100 * d - 208 * e + 128) >> 8) << 8 |
+	       emuClamp((298 * c + 516 * d + 128) >> 8);
+}
+
+/* Pixel (x, y) of the image as premultiplied ARGB8888 */
+static uint32_t emuRead( const EmuImage *img, int x, int y )
+{
+	unsigned char *row = img->bits + y * img->pitch;
+	uint32_t p;
+
+	switch (img->fmt)
+	{
+	case BLT_FMT_16_BIT_ARGB4444:
+		p = ((uint16_t *)row)[x];
+		return emuExpand(p >> 12, 4) << 24 | emuExpand((p >> 8) & 0xf, 4) << 16 |
+		       emuExpand((p >> 4) & 0xf, 4) << 8 | emuExpand(p & 0xf, 4);
+	case BLT_FMT_16_BIT_ARGB1555:
+		p = ((uint16_t *)row)[x];
+		return (p & 0x8000 ? 0xff000000 : 0) | emuExpand((p >> 10) & 0x1f, 5) << 16 |
+		       emuExpand((p >> 5) & 0x1f, 5) << 8 | emuExpand(p & 0x1f, 5);
+	case BLT_FMT_16_BIT_RGB565:
+		p = ((uint16_t *)row)[x];
+		return 0xff000000 | emuExpand(p >> 11, 5) << 16 |
+		       emuExpand((p >> 5) & 0x3f, 6) << 8 | emuExpand(p & 0x1f, 5);
+	case BLT_FMT_24_BIT_RGB888:
+		row += 3 * x;
+		return 0xff000000 | row[2] << 16 | row[1] << 8 | row[0];
+	case BLT_FMT_32_BIT_ARGB8888:
+		return ((uint32_t *)row)[x];
+	case BLT_FMT_32_BIT_ABGR8888:
+		p = ((uint32_t *)row)[x];
+		return (p & 0xff00ff00) | (p & 0xff) << 16 | ((p >> 16) & 0xff);
+	case BLT_FMT_CB_Y_CR_Y:
+		row += 4 * (x / 2);
+		return emuYuvToArgb(row[1 + 2 * (x & 1)], row[0], row[2]);
+	case BLT_FMT_Y_CB_Y_CR:
+		row += 4 * (x / 2);
+		return emuYuvToArgb(row[2 * (x & 1)], row[1], row[3]);
+	case BLT_FMT_YUV420_PACKED_PLANAR:
+	{
+		unsigned char *u = img->bits + img->pitch * img->height;
+		unsigned char *v = u + (img->pitch / 2) * (img->height / 2);
+		int c = (y / 2) * (img->pitch / 2) + x / 2;
+
+		return emuYuvToArgb(row[x], u[c], v[c]);
+	}
+	default:
+		return 0;
+	}
+}
+
+static void emuWrite( const EmuImage *img, int x, int y, uint32_t p )
+{
+	unsigned char *row = img->bits + y * img->pitch;
+	uint32_t a = p >> 24, r = (p >> 16) & 0xff, g = (p >> 8) & 0xff, b = p & 0xff;
+
+	switch (img->fmt)
+	{
+	case BLT_FMT_16_BIT_ARGB4444:
+		((uint16_t *)row)[x] = (a >> 4) << 12 | (r >> 4) << 8 | (g >> 4) << 4 | b >> 4;
+		break;
+	case BLT_FMT_16_BIT_ARGB1555:
+		((uint16_t *)row)[x] = (a >> 7) << 15 | (r >> 3) << 10 | (g >> 3) << 5 | b >> 3;
+		break;
+	case BLT_FMT_16_BIT_RGB565:
+		((uint16_t *)row)[x] = (r >> 3) << 11 | (g >> 2) << 5 | b >> 3;
+		break;
+	case BLT_FMT_24_BIT_RGB888:
+		row += 3 * x;
+		row[0] = b;
+		row[1] = g;
+		row[2] = r;
+		break;
+	case BLT_FMT_32_BIT_ARGB8888:
+		((uint32_t *)row)[x] = p;
+		break;
+	case BLT_FMT_32_BIT_ABGR8888:
+		((uint32_t *)row)[x] = a << 24 | b << 16 | g << 8 | r;
+		break;
+	default:
+		break;
+	}
+}
+
+/* Store a raw pixel value, as SOURCE_FILL_RAW does */
+static void emuWriteRaw( const EmuImage *img, int x, int y, uint32_t p )
+{
+	unsigned char *row = img->bits + y * img->pitch;
+
+	switch (emuBpp(img->fmt))
+	{
+	case 16:
+		((uint16_t *)row)[x] = p;
+		break;
+	case 24:
+		row += 3 * x;
+		row[0] = p;
+		row[1] = p >> 8;
+		row[2] = p >> 16;
+		break;
+	case 32:
+		((uint32_t *)row)[x] = p;
+		break;
+	}
+}
+
+static uint32_t emuMul( uint32_t c, uint32_t a )
+{
+	return (c * a + 127) / 255;
+}
+
+static uint32_t emuScale( uint32_t p, uint32_t a )
+{
+	return emuMul(p >> 24, a) << 24 | emuMul((p >> 16) & 0xff, a) << 16 |
+	       emuMul((p >> 8) & 0xff, a) << 8 | emuMul(p & 0xff, a);
+}
+
+/* src Over dst, both premultiplied */
+static uint32_t emuOver( uint32_t src, uint32_t dst )
+{
+	uint32_t ia = 255 - (src >> 24);
+	uint32_t d = emuScale(dst, ia);
+	uint32_t res = 0;
+	int shift;
+
+	for (shift = 0; shift < 32; shift += 8)
+		res |= EMU_MIN(((src >> shift) & 0xff) + ((d >> shift) & 0xff), 0xff) << shift;
+
+	return res;
+}
+
+static void emuClip( struct blt_rect *r, int x1, int y1, int x2, int y2 )
+{
+	int rx2 = EMU_MIN(r->x + r->width, x2);
+	int ry2 = EMU_MIN(r->y + r->height, y2);
+
+	r->x = EMU_MAX(r->x, x1);
+	r->y = EMU_MAX(r->y, y1);
+	r->width = EMU_MAX(rx2 - r->x, 0);
+	r->height = EMU_MAX(ry2 - r->y, 0);
+}
+
+static int emuExecute( const struct blt_req *req )
+{
+	const enum blt_flag supported = BLT_FLAG_ASYNCH | BLT_FLAG_DRY_RUN | BLT_FLAG_PER_PIXEL_ALPHA_BLEND |
+		BLT_FLAG_GLOBAL_ALPHA_BLEND | BLT_FLAG_SOURCE_FILL | BLT_FLAG_SOURCE_FILL_RAW |
+		BLT_FLAG_SRC_IS_NOT_PREMULT | BLT_FLAG_DESTINATION_CLIP | BLT_FLAG_INHERIT_PRIO |
+		BLT_FLAG_SRC_NO_CACHE_FLUSH | BLT_FLAG_SRC_MASK_NO_CACHE_FLUSH | BLT_FLAG_DST_NO_CACHE_FLUSH;
+	int fill = (req->flags & (BLT_FLAG_SOURCE_FILL | BLT_FLAG_SOURCE_FILL_RAW)) != 0;
+	EmuImage src, dst;
+	struct blt_rect area;
+	uint32_t step_x = 0, step_y = 0;
+	int x, y;
+
+	if (req->size != sizeof(*req) || (req->flags & ~supported) || req->transform != BLT_TRANSFORM_NONE)
+		return -EINVAL;
+
+	if (req->src_mask.buf.type != BLT_PTR_NONE && req->src_mask.fmt != BLT_FMT_UNUSED)
+		return -EINVAL;
+
+	if (!emuSetupImage(&req->dst_img, &dst) || !emuIsRgb(dst.fmt))
+		return -EINVAL;
+
+	if (!fill)
+	{
+		if (!emuSetupImage(&req->src_img, &src) ||
+		    req->src_rect.width <= 0 || req->src_rect.height <= 0 ||
+		    req->src_rect.x < 0 || req->src_rect.y < 0 ||
+		    req->src_rect.x + req->src_rect.width > src.width ||
+		    req->src_rect.y + req->src_rect.height > src.height)
+			return -EINVAL;
+	}
+
+	if (req->dst_rect.width <= 0 || req->dst_rect.height <= 0)
+		return -EINVAL;
+
+	if (!fill)
+	{
+		step_x = ((uint32_t)req->src_rect.width << 16) / req->dst_rect.width;
+		step_y = ((uint32_t)req->src_rect.height << 16) / req->dst_rect.height;
+	}
+
+	area = req->dst_rect;
+	emuClip(&area, 0, 0, dst.width, dst.height);
+	if (req->flags & BLT_FLAG_DESTINATION_CLIP)
+		emuClip(&area, req->dst_clip_rect.x, req->dst_clip_rect.y,
+			req->dst_clip_rect.x + req->dst_clip_rect.width,
+			req->dst_clip_rect.y + req->dst_clip_rect.height);
+
+	if (req->flags & BLT_FLAG_DRY_RUN)
+		return 0;
+
+	for (y = area.y; y < area.y + area.height; y++)
+	{
+		int sy = req->src_rect.y + (int)(((y - req->dst_rect.y) * step_y + step_y / 2) >> 16);
+
+		for (x = area.x; x < area.x + area.width; x++)
+		{
+			uint32_t p;
+
+			if (req->flags & BLT_FLAG_SOURCE_FILL_RAW)
+			{
+				emuWriteRaw(&dst, x, y, req->src_color);
+				continue;
+			}
+
+			if (fill)
+				p = req->src_color;
+			else
+				p = emuRead(&src, req->src_rect.x + (int)(((x - req->dst_rect.x) * step_x + step_x / 2) >> 16), sy);
+
+			if (req->flags & BLT_FLAG_SRC_IS_NOT_PREMULT)
+				p = (p & 0xff000000) | (emuScale(p, p >> 24) & 0x00ffffff);
+			if (req->flags & BLT_FLAG_GLOBAL_ALPHA_BLEND)
+				p = emuScale(p, req->global_alpha);
+			if (req->flags & (BLT_FLAG_PER_PIXEL_ALPHA_BLEND | BLT_FLAG_GLOBAL_ALPHA_BLEND))
+				p = emuOver(p, emuRead(&dst, x, y));
+
+			emuWrite(&dst, x, y, p);
+		}
+	}
+
+	return 0;
+}
+
+int blt_open( void )
+{
+	int i;
+
+	for (i = 0; i < EMU_MAX_HANDLES; i++)
+	{
+		if (!emu_open[i])
+		{
+			emu_open[i] = 1;
+			emu_last_request[i] = 0;
+			return i;
+		}
+	}
+
+	errno = EMFILE;
+	return -1;
+}
+
+void blt_close( int blt )
+{
+	if (blt >= 0 && blt < EMU_MAX_HANDLES)
+		emu_open[blt] = 0;
+}
+
+int blt_request( int blt, struct blt_req *req )
+{
+	int ret;
+
+	if (blt < 0 || blt >= EMU_MAX_HANDLES || !emu_open[blt])
+	{
+		errno = EBADF;
+		return -1;
+	}
+
+	ret = emuExecute(req);
+	if (ret < 0)
+	{
+		errno = -ret;
+		return -1;
+	}
+
+	/* request ids are positive and increase per handle, like the real ones */
+	if (++emu_last_request[blt] <= 0)
+		emu_last_request[blt] = 1;
+
+	return emu_last_request[blt];
+}
+
+int blt_synch( int blt, int request_id )
+{
+	(void)request_id;
+
+	if (blt < 0 || blt >= EMU_MAX_HANDLES || !emu_open[blt])
+	{
+		errno = EBADF;
+		return -1;
+	}
+
+	return 0;
+}
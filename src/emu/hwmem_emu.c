@@ -0,0 +1,299 @@
+/*
+ * Copyright (C) ST-Ericsson SA 2011
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+/*
+ * /dev/hwmem emulation.
+ *
+ * Every allocation is a memfd, so that mappings handed to the driver can
+ * be unmapped independently of the view the emulated blitter keeps. The
+ * ids returned by HWMEM_ALLOC_IOC and HWMEM_IMPORT_IOC are handles into
+ * one table, several of which may refer to the same buffer; global names
+ * are the buffer's table index plus one. Domain changes only check the
+ * region, the memory is coherent.
+ */
+
+/* memfd_create */
+#define _GNU_SOURCE
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <linux/hwmem.h>
+
+#include "mali_hwmem.h"
+#include "mali_emu.h"
+
+#define EMU_PAGE_SIZE 4096
+
+typedef struct
+{
+	int memfd;		/* -1 for a free slot */
+	unsigned char *base;
+	unsigned long size;
+	int refs;
+} EmuBuffer;
+
+static pthread_mutex_t emu_lock = PTHREAD_MUTEX_INITIALIZER;
+static EmuBuffer *buffers;
+static int num_buffers;
+static int *handles;		/* handle - 1 -> buffer index, -1 when free */
+static int num_handles;
+
+#define EMU_TABLE_STEP 64
+
+static int emuBufferSlot( void )
+{
+	EmuBuffer *grown;
+	int i;
+
+	for (i = 0; i < num_buffers; i++)
+		if (buffers[i].memfd < 0)
+			return i;
+
+	grown = realloc(buffers, (num_buffers + EMU_TABLE_STEP) * sizeof(*buffers));
+	if (!grown)
+		return -1;
+
+	buffers = grown;
+	for (i = num_buffers; i < num_buffers + EMU_TABLE_STEP; i++)
+		buffers[i].memfd = -1;
+	num_buffers += EMU_TABLE_STEP;
+
+	return i - EMU_TABLE_STEP;
+}
+
+static int emuHandleSlot( void )
+{
+	int *grown;
+	int i;
+
+	for (i = 0; i < num_handles; i++)
+		if (handles[i] < 0)
+			return i;
+
+	grown = realloc(handles, (num_handles + EMU_TABLE_STEP) * sizeof(*handles));
+	if (!grown)
+		return -1;
+
+	handles = grown;
+	for (i = num_handles; i < num_handles + EMU_TABLE_STEP; i++)
+		handles[i] = -1;
+	num_handles += EMU_TABLE_STEP;
+
+	return i - EMU_TABLE_STEP;
+}
+
+static int emuNewHandle( int buffer )
+{
+	int h = emuHandleSlot();
+
+	if (h < 0)
+		return -ENOMEM;
+
+	handles[h] = buffer;
+	buffers[buffer].refs++;
+
+	return h + 1;
+}
+
+static EmuBuffer *emuHandleBuffer( int handle )
+{
+	if (handle <= 0 || handle > num_handles || handles[handle - 1] < 0)
+		return NULL;
+
+	return &buffers[handles[handle - 1]];
+}
+
+static int emuAlloc( struct hwmem_alloc_request *req )
+{
+	unsigned long size = (req->size + EMU_PAGE_SIZE - 1) & ~(EMU_PAGE_SIZE - 1);
+	EmuBuffer *buf;
+	int b, h;
+
+	if (!size)
+		return -EINVAL;
+
+	b = emuBufferSlot();
+	if (b < 0)
+		return -ENOMEM;
+
+	buf = &buffers[b];
+	buf->memfd = memfd_create("hwmem", 0);
+	if (buf->memfd < 0)
+		return -errno;
+
+	if (ftruncate(buf->memfd, size) < 0 ||
+	    (buf->base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, buf->memfd, 0)) == MAP_FAILED)
+	{
+		close(buf->memfd);
+		buf->memfd = -1;
+		return -ENOMEM;
+	}
+
+	buf->size = size;
+	buf->refs = 0;
+
+	h = emuNewHandle(b);
+	if (h < 0)
+	{
+		munmap(buf->base, size);
+		close(buf->memfd);
+		buf->memfd = -1;
+	}
+
+	return h;
+}
+
+static int emuRelease( int handle )
+{
+	EmuBuffer *buf = emuHandleBuffer(handle);
+
+	if (!buf)
+		return -EINVAL;
+
+	handles[handle - 1] = -1;
+	if (--buf->refs == 0)
+	{
+		munmap(buf->base, buf->size);
+		close(buf->memfd);
+		buf->memfd = -1;
+	}
+
+	return 0;
+}
+
+static int emuSetDomain( struct hwmem_set_domain_request *req )
+{
+	EmuBuffer *buf = emuHandleBuffer(req->id);
+	struct hwmem_region *r = &req->region;
+
+	if (!buf || !r->count || r->start > r->end || r->end > r->size)
+		return -EINVAL;
+
+	/* the last repetition must still be inside the buffer */
+	if ((unsigned long)r->offset + (unsigned long)(r->count - 1) * r->size + r->end > buf->size)
+		return -EINVAL;
+
+	return 0;
+}
+
+static int emuIoctl( unsigned long request, unsigned long arg )
+{
+	EmuBuffer *buf;
+
+	switch (request)
+	{
+	case HWMEM_ALLOC_IOC:
+		return emuAlloc((struct hwmem_alloc_request *)arg);
+	case HWMEM_RELEASE_IOC:
+		return emuRelease((int)arg);
+	case HWMEM_SET_CPU_DOMAIN_IOC:
+	case HWMEM_SET_SYNC_DOMAIN_IOC:
+		return emuSetDomain((struct hwmem_set_domain_request *)arg);
+	case HWMEM_EXPORT_IOC:
+		buf = emuHandleBuffer((int)arg);
+		return buf ? (int)(buf - buffers) + 1 : -EINVAL;
+	case HWMEM_IMPORT_IOC:
+		if ((int)arg <= 0 || (int)arg > num_buffers || buffers[arg - 1].memfd < 0)
+			return -EINVAL;
+		return emuNewHandle((int)arg - 1);
+	default:
+		return -ENOTTY;
+	}
+}
+
+int maliHwmemDevOpen( void )
+{
+	/* any descriptor will do, nothing is ever read from it */
+	return open("/dev/null", O_RDWR);
+}
+
+void maliHwmemDevClose( int fd )
+{
+	close(fd);
+}
+
+int maliHwmemDevIoctl( int fd, unsigned long request, unsigned long arg )
+{
+	int ret;
+
+	(void)fd;
+
+	pthread_mutex_lock(&emu_lock);
+	ret = emuIoctl(request, arg);
+	pthread_mutex_unlock(&emu_lock);
+
+	if (ret < 0)
+	{
+		errno = -ret;
+		return -1;
+	}
+
+	return ret;
+}
+
+void *maliHwmemDevMmap( int fd, int alloc, unsigned long size )
+{
+	EmuBuffer *buf;
+	void *addr = MAP_FAILED;
+
+	(void)fd;
+
+	pthread_mutex_lock(&emu_lock);
+	buf = emuHandleBuffer(alloc);
+	if (buf && size <= buf->size)
+		addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, buf->memfd, 0);
+	else
+		errno = EINVAL;
+	pthread_mutex_unlock(&emu_lock);
+
+	return addr;
+}
+
+void maliHwmemDevMunmap( void *addr, unsigned long size )
+{
+	munmap(addr, size);
+}
+
+unsigned char *maliEmuHwmemLookup( int name, unsigned long *size )
+{
+	unsigned char *base = NULL;
+
+	pthread_mutex_lock(&emu_lock);
+	if (name > 0 && name <= num_buffers && buffers[name - 1].memfd >= 0)
+	{
+		base = buffers[name - 1].base;
+		*size = buffers[name - 1].size;
+	}
+	pthread_mutex_unlock(&emu_lock);
+
+	return base;
+}
@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) ST-Ericsson SA 2011
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * The part of the hwmem user space API used by the driver, for the
+ * emulation build, see hwmem_emu.c.
+ */
+
+#ifndef _HWMEM_H_
+#define _HWMEM_H_
+
+#include <stdint.h>
+#include <sys/ioctl.h>
+
+enum hwmem_alloc_flags {
+	HWMEM_ALLOC_HINT_WRITE_COMBINE    = (1 << 0),
+	HWMEM_ALLOC_HINT_NO_WRITE_COMBINE = (1 << 1),
+	HWMEM_ALLOC_HINT_CACHED           = (1 << 2),
+	HWMEM_ALLOC_HINT_UNCACHED         = (1 << 3),
+};
+
+enum hwmem_access {
+	HWMEM_ACCESS_READ   = (1 << 0),
+	HWMEM_ACCESS_WRITE  = (1 << 1),
+	HWMEM_ACCESS_IMPORT = (1 << 2),
+};
+
+enum hwmem_mem_type {
+	HWMEM_MEM_SCATTERED_SYS,
+	HWMEM_MEM_CONTIGUOUS_SYS,
+};
+
+struct hwmem_region {
+	uint32_t offset;
+	uint32_t count;
+	uint32_t start;
+	uint32_t end;
+	uint32_t size;
+};
+
+struct hwmem_alloc_request {
+	uint32_t size;
+	uint32_t flags;
+	uint32_t default_access;
+	uint32_t mem_type;
+};
+
+struct hwmem_set_domain_request {
+	int32_t id;
+	uint32_t access;
+	struct hwmem_region region;
+};
+
+#define HWMEM_IOC_MAGIC 0xd9
+
+#define HWMEM_ALLOC_IOC           _IOW(HWMEM_IOC_MAGIC, 1, struct hwmem_alloc_request)
+#define HWMEM_RELEASE_IOC         _IO(HWMEM_IOC_MAGIC, 3)
+#define HWMEM_SET_CPU_DOMAIN_IOC  _IOW(HWMEM_IOC_MAGIC, 4, struct hwmem_set_domain_request)
+#define HWMEM_SET_SYNC_DOMAIN_IOC _IOW(HWMEM_IOC_MAGIC, 5, struct hwmem_set_domain_request)
+#define HWMEM_EXPORT_IOC          _IO(HWMEM_IOC_MAGIC, 8)
+#define HWMEM_IMPORT_IOC          _IO(HWMEM_IOC_MAGIC, 9)
+
+#endif /* _HWMEM_H_ */
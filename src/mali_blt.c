@@ -0,0 +1,693 @@
+/*
+ * Copyright (C) ST-Ericsson SA 2011
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Asynchronous blit submission on top of libblt_hw.
+ *
+ * Every request handed to blt_request is tagged with a driver side job
+ * number. The request IDs returned by libblt_hw are kept until the job is
+ * known to be complete, so callers can wait for one particular job instead
+ * of draining the whole blitter with blt_synch(handle, 0).
+ *
+ * Requests on one handle are executed in submission order, so once a job
+ * has completed every job submitted before it has completed as well.
+ *
+ * With a submission thread, maliBltSubmit copies the request into a
+ * single producer, single consumer ring and returns. The thread issues
+ * queued requests and absorbs EAGAIN from a busy blitter. blt_synch cannot
+ * be interrupted, so a completion thread of its own waits for the oldest
+ * blit in flight, which reports completions as they happen without holding
+ * up requests queued meanwhile. The two share the in-flight table under
+ * its lock. The server sleeps on an eventfd either thread signals when it
+ * has made progress; the submission thread in turn sleeps on an eventfd the
+ * server kicks when the queue goes from empty to non-empty.
+ *
+ * The blitter runs several handles in parallel, but only keeps order
+ * within one. MaliBltSchedRec spreads work over a few channels, each a
+ * MaliBltRec of its own, and keeps dependent work on the same channel.
+ *
+ * Every blit belongs to a class (MaliBltClass) whose priority goes into
+ * the request, which decides between requests the blitter has queued
+ * from several handles. Within a channel, order is never changed.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+#include <string.h>
+#include <signal.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include "mali_blt.h"
+
+/* Fields shared with the submission thread, sequentially consistent so that
+ * a flag set before checking a condition is seen by the side changing it */
+#define MALI_BLT_LOAD( field ) __atomic_load_n(&(field), __ATOMIC_SEQ_CST)
+#define MALI_BLT_STORE( field, value ) __atomic_store_n(&(field), (value), __ATOMIC_SEQ_CST)
+
+static const char *maliBltClassNames[MALI_BLT_NUM_CLASSES] = {
+	"xv", "dri2", "fill", "copy", "upload"
+};
+
+/* Bytes per destination pixel, for the statistics */
+static int maliBltFormatBytes( enum blt_fmt fmt )
+{
+	switch (fmt)
+	{
+		case BLT_FMT_16_BIT_ARGB4444:
+		case BLT_FMT_16_BIT_ARGB1555:
+		case BLT_FMT_16_BIT_RGB565:
+		case BLT_FMT_CB_Y_CR_Y:
+		case BLT_FMT_Y_CB_Y_CR:
+			return 2;
+		case BLT_FMT_24_BIT_RGB888:
+			return 3;
+		default:
+			return 4;
+	}
+}
+
+static void maliBltSignal( int fd )
+{
+	uint64_t one = 1;
+
+	(void)write(fd, &one, sizeof(one));
+}
+
+static void maliBltSleep( int fd )
+{
+	uint64_t count;
+
+	(void)read(fd, &count, sizeof(count));
+}
+
+static MaliBltInflight *maliBltOldest( MaliBltPtr blt )
+{
+	return &blt->inflight[blt->inflight_first];
+}
+
+/* Drop the tracking entries of all jobs up to and including job, with the lock held */
+static void maliBltRetire( MaliBltPtr blt, MaliBltJob job )
+{
+	CARD64 now = blt->num_inflight > 0 ? maliTraceNow() : 0;
+
+	while (blt->num_inflight > 0 && !MALI_BLT_JOB_AFTER(maliBltOldest(blt)->job, job))
+	{
+		MaliBltInflight *entry = maliBltOldest(blt);
+
+		if (entry->request_id >= 0)
+			__atomic_add_fetch(&blt->latency[entry->cls].complete_ns, now - entry->submit_ns, __ATOMIC_RELAXED);
+		MALI_TRACE_INSTANT(blt->trace, MALI_TRACE_BLT_COMPLETE, entry->job, 0);
+		blt->inflight_first = (blt->inflight_first + 1) % MALI_BLT_MAX_INFLIGHT;
+		blt->num_inflight--;
+	}
+
+	if (MALI_BLT_JOB_AFTER(job, blt->retired_job))
+		MALI_BLT_STORE(blt->retired_job, job);
+}
+
+/* Wait for all jobs up to and including job, which must be in flight */
+static void maliBltSynch( MaliBltPtr blt, MaliBltJob job )
+{
+	int request_id = -1;
+	int i;
+
+	pthread_mutex_lock(&blt->lock);
+	for (i = 0; i < blt->num_inflight; i++)
+	{
+		MaliBltInflight *entry = &blt->inflight[(blt->inflight_first + i) % MALI_BLT_MAX_INFLIGHT];
+
+		if (MALI_BLT_JOB_AFTER(entry->job, job))
+			break;
+
+		if (entry->request_id >= 0)
+			request_id = entry->request_id;
+	}
+	pthread_mutex_unlock(&blt->lock);
+
+	if (request_id >= 0)
+		(void)blt_synch(blt->handle, request_id);
+
+	pthread_mutex_lock(&blt->lock);
+	maliBltRetire(blt, job);
+	pthread_mutex_unlock(&blt->lock);
+}
+
+/* The oldest job in flight, 0 if there is none */
+static MaliBltJob maliBltOldestJob( MaliBltPtr blt, int limit )
+{
+	MaliBltJob job = 0;
+
+	pthread_mutex_lock(&blt->lock);
+	if (blt->num_inflight >= limit && blt->num_inflight > 0)
+		job = maliBltOldest(blt)->job;
+	pthread_mutex_unlock(&blt->lock);
+
+	return job;
+}
+
+/* Account a wait for room in the window, the queue or the blitter */
+static void maliBltStalled( MaliBltPtr blt, CARD64 start )
+{
+	__atomic_add_fetch(&blt->stalls, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&blt->stall_ns, maliTraceNow() - start, __ATOMIC_RELAXED);
+}
+
+/* Account the time a request of class cls waited before libblt_hw took it */
+static void maliBltQueued( MaliBltPtr blt, MaliBltClass cls, CARD64 submit_ns )
+{
+	MaliBltLatency *latency = &blt->latency[cls];
+	CARD64 queue_ns = maliTraceNow() - submit_ns;
+
+	__atomic_add_fetch(&latency->jobs, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&latency->queue_ns, queue_ns, __ATOMIC_RELAXED);
+	if (queue_ns > __atomic_load_n(&latency->queue_max_ns, __ATOMIC_RELAXED))
+		__atomic_store_n(&latency->queue_max_ns, queue_ns, __ATOMIC_RELAXED);
+}
+
+/*
+ * Hand a request to libblt_hw and track it as job.
+ *
+ * At most window requests are kept in flight; beyond that the oldest one
+ * is waited for first. A request the blitter has no room for (EAGAIN)
+ * waits for the oldest of ours in flight before it is retried. With none
+ * in flight the blitter is busy with other clients and is polled with an
+ * exponentially growing sleep.
+ */
+static Bool maliBltIssue( MaliBltPtr blt, MaliBltJob job, MaliBltClass cls, CARD64 submit_ns, struct blt_req *req )
+{
+	MaliBltInflight *entry;
+	MaliBltJob oldest;
+	unsigned int backoff = MALI_BLT_BACKOFF_MIN_US;
+	CARD64 start;
+	int status;
+
+	oldest = maliBltOldestJob(blt, blt->window);
+	if (oldest)
+	{
+		start = maliTraceNow();
+		maliBltSynch(blt, oldest);
+		maliBltStalled(blt, start);
+	}
+
+	for (;;)
+	{
+		status = blt_request(blt->handle, req);
+		if (status >= 0 || errno != EAGAIN)
+			break;
+
+		start = maliTraceNow();
+		oldest = maliBltOldestJob(blt, 1);
+		if (oldest)
+			maliBltSynch(blt, oldest);
+		else
+		{
+			usleep(backoff);
+			backoff = min(backoff * 2, MALI_BLT_BACKOFF_MAX_US);
+		}
+		maliBltStalled(blt, start);
+	}
+
+	/* reported by the server, see maliBltLogFailures */
+	if (status < 0)
+	{
+		__atomic_store_n(&blt->failed_errno, errno, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&blt->failed, 1, __ATOMIC_RELAXED);
+	}
+	else
+		maliBltQueued(blt, cls, submit_ns);
+
+	/* a failed job stays in the table so that waits for it are ordered */
+	pthread_mutex_lock(&blt->lock);
+	entry = &blt->inflight[(blt->inflight_first + blt->num_inflight) % MALI_BLT_MAX_INFLIGHT];
+	entry->job = job;
+	entry->request_id = status;
+	entry->cls = cls;
+	entry->submit_ns = submit_ns;
+	blt->num_inflight++;
+	pthread_cond_signal(&blt->inflight_cond);
+	pthread_mutex_unlock(&blt->lock);
+
+	return status >= 0;
+}
+
+static void *maliBltThread( void *data )
+{
+	MaliBltPtr blt = data;
+
+	while (!MALI_BLT_LOAD(blt->quit))
+	{
+		unsigned int tail = blt->queue_tail;
+
+		if (tail != MALI_BLT_LOAD(blt->queue_head))
+		{
+			MaliBltQueued *queued = &blt->queue[tail % MALI_BLT_QUEUE_SIZE];
+
+			(void)maliBltIssue(blt, queued->job, queued->cls, queued->submit_ns, &queued->req);
+			MALI_BLT_STORE(blt->queue_tail, tail + 1);
+		}
+		else
+		{
+			MALI_BLT_STORE(blt->thread_idle, TRUE);
+			if (tail == MALI_BLT_LOAD(blt->queue_head) && !MALI_BLT_LOAD(blt->quit))
+				maliBltSleep(blt->kick_fd);
+			MALI_BLT_STORE(blt->thread_idle, FALSE);
+			continue;
+		}
+
+		if (MALI_BLT_LOAD(blt->server_waiting))
+			maliBltSignal(blt->done_fd);
+	}
+
+	return NULL;
+}
+
+/* Wait for the blits in flight one after the other, as they complete */
+static void *maliBltCompletionThread( void *data )
+{
+	MaliBltPtr blt = data;
+
+	pthread_mutex_lock(&blt->lock);
+	while (!MALI_BLT_LOAD(blt->quit))
+	{
+		MaliBltJob job;
+
+		if (blt->num_inflight == 0)
+		{
+			pthread_cond_wait(&blt->inflight_cond, &blt->lock);
+			continue;
+		}
+
+		job = maliBltOldest(blt)->job;
+		pthread_mutex_unlock(&blt->lock);
+
+		maliBltSynch(blt, job);
+		if (MALI_BLT_LOAD(blt->server_waiting))
+			maliBltSignal(blt->done_fd);
+
+		pthread_mutex_lock(&blt->lock);
+	}
+	pthread_mutex_unlock(&blt->lock);
+
+	return NULL;
+}
+
+static Bool maliBltStartThread( MaliBltPtr blt )
+{
+	sigset_t all, saved;
+	int ret;
+
+	blt->kick_fd = eventfd(0, 0);
+	blt->done_fd = eventfd(0, 0);
+	if (blt->kick_fd < 0 || blt->done_fd < 0)
+		goto fail;
+
+	/* the thread inherits the mask, server signals stay with the server */
+	sigfillset(&all);
+	pthread_sigmask(SIG_BLOCK, &all, &saved);
+	ret = pthread_create(&blt->thread, NULL, maliBltThread, blt);
+	if (ret == 0)
+	{
+		ret = pthread_create(&blt->completion_thread, NULL, maliBltCompletionThread, blt);
+		if (ret != 0)
+		{
+			MALI_BLT_STORE(blt->quit, TRUE);
+			maliBltSignal(blt->kick_fd);
+			pthread_join(blt->thread, NULL);
+			MALI_BLT_STORE(blt->quit, FALSE);
+		}
+	}
+	pthread_sigmask(SIG_SETMASK, &saved, NULL);
+	if (ret != 0)
+		goto fail;
+
+	blt->threaded = TRUE;
+
+	return TRUE;
+
+fail:
+	if (blt->kick_fd >= 0)
+		close(blt->kick_fd);
+	if (blt->done_fd >= 0)
+		close(blt->done_fd);
+	blt->kick_fd = blt->done_fd = -1;
+
+	return FALSE;
+}
+
+static void maliBltStopThread( MaliBltPtr blt )
+{
+	MALI_BLT_STORE(blt->quit, TRUE);
+	maliBltSignal(blt->kick_fd);
+	pthread_join(blt->thread, NULL);
+
+	pthread_mutex_lock(&blt->lock);
+	pthread_cond_signal(&blt->inflight_cond);
+	pthread_mutex_unlock(&blt->lock);
+	pthread_join(blt->completion_thread, NULL);
+
+	close(blt->kick_fd);
+	close(blt->done_fd);
+	blt->kick_fd = blt->done_fd = -1;
+	blt->threaded = FALSE;
+}
+
+Bool maliBltOpen( MaliBltPtr blt, int index, Bool threaded, int window )
+{
+	memset(blt, 0, sizeof(*blt));
+	blt->index = index;
+	blt->last_job = blt->retired_job = index;
+	blt->kick_fd = blt->done_fd = -1;
+	blt->window = window > 0 && window < MALI_BLT_MAX_INFLIGHT ? window : MALI_BLT_MAX_INFLIGHT;
+	pthread_mutex_init(&blt->lock, NULL);
+	pthread_cond_init(&blt->inflight_cond, NULL);
+
+	blt->handle = blt_open();
+	if (blt->handle < 0)
+	{
+		pthread_cond_destroy(&blt->inflight_cond);
+		pthread_mutex_destroy(&blt->lock);
+		return FALSE;
+	}
+
+	if (threaded && !maliBltStartThread(blt))
+		ErrorF("mali: no blit submission thread, submitting from the server\n");
+
+	return TRUE;
+}
+
+void maliBltClose( MaliBltPtr blt )
+{
+	if (blt->handle < 0)
+		return;
+
+	maliBltWaitAll(blt);
+	if (blt->threaded)
+		maliBltStopThread(blt);
+	blt_close(blt->handle);
+	blt->handle = -1;
+	pthread_cond_destroy(&blt->inflight_cond);
+	pthread_mutex_destroy(&blt->lock);
+}
+
+/* Sleep until the submission thread has consumed a queued request */
+static void maliBltWaitQueue( MaliBltPtr blt )
+{
+	CARD64 start = maliTraceNow();
+
+	MALI_BLT_STORE(blt->server_waiting, TRUE);
+	while (blt->queue_head - MALI_BLT_LOAD(blt->queue_tail) == MALI_BLT_QUEUE_SIZE)
+		maliBltSleep(blt->done_fd);
+	MALI_BLT_STORE(blt->server_waiting, FALSE);
+
+	maliBltStalled(blt, start);
+}
+
+/* Log the failed requests since the last call, from the server thread only */
+static void maliBltLogFailures( MaliBltPtr blt )
+{
+	unsigned long failed = __atomic_load_n(&blt->failed, __ATOMIC_RELAXED);
+
+	if (failed == blt->failed_logged)
+		return;
+
+	ErrorF("mali: %lu blit requests failed, last errno %d\n", failed - blt->failed_logged,
+	       __atomic_load_n(&blt->failed_errno, __ATOMIC_RELAXED));
+	blt->failed_logged = failed;
+}
+
+MaliBltJob maliBltSubmit( MaliBltPtr blt, struct blt_req *req, MaliBltClass cls )
+{
+	MaliBltJob job = blt->last_job + MALI_BLT_MAX_CHANNELS;
+	CARD64 submit_ns = maliTraceNow();
+
+	if (job == 0)
+		job = MALI_BLT_MAX_CHANNELS;
+
+	maliBltLogFailures(blt);
+
+	req->prio = blt->prio[cls];
+
+	if (blt->threaded)
+	{
+		MaliBltQueued *queued;
+
+		if (blt->queue_head - MALI_BLT_LOAD(blt->queue_tail) == MALI_BLT_QUEUE_SIZE)
+			maliBltWaitQueue(blt);
+
+		queued = &blt->queue[blt->queue_head % MALI_BLT_QUEUE_SIZE];
+		queued->job = job;
+		queued->cls = cls;
+		queued->submit_ns = submit_ns;
+		queued->req = *req;
+		MALI_BLT_STORE(blt->queue_head, blt->queue_head + 1);
+
+		if (MALI_BLT_LOAD(blt->thread_idle))
+			maliBltSignal(blt->kick_fd);
+	}
+	else if (!maliBltIssue(blt, job, cls, submit_ns, req))
+	{
+		/* nothing to wait for */
+		blt->last_job = job;
+		return 0;
+	}
+
+	blt->last_job = job;
+	blt->submitted++;
+	blt->bytes += (CARD64)req->dst_rect.width * req->dst_rect.height * maliBltFormatBytes(req->dst_img.fmt);
+
+	MALI_TRACE_INSTANT(blt->trace, MALI_TRACE_BLT_SUBMIT, job, req->dst_rect.width * req->dst_rect.height);
+
+	return job;
+}
+
+Bool maliBltJobDone( MaliBltPtr blt, MaliBltJob job )
+{
+	return job == 0 || !MALI_BLT_JOB_AFTER(job, MALI_BLT_LOAD(blt->retired_job));
+}
+
+void maliBltWait( MaliBltPtr blt, MaliBltJob job )
+{
+	CARD64 trace_start;
+
+	if (maliBltJobDone(blt, job))
+		return;
+
+	trace_start = MALI_TRACE_BEGIN(blt->trace);
+	blt->waits++;
+
+	if (blt->threaded)
+	{
+		MALI_BLT_STORE(blt->server_waiting, TRUE);
+		while (!maliBltJobDone(blt, job))
+			maliBltSleep(blt->done_fd);
+		MALI_BLT_STORE(blt->server_waiting, FALSE);
+	}
+	else
+		maliBltSynch(blt, job);
+
+	maliBltLogFailures(blt);
+
+	MALI_TRACE_END(blt->trace, MALI_TRACE_BLT_WAIT, trace_start, job, 0);
+}
+
+void maliBltWaitAll( MaliBltPtr blt )
+{
+	CARD64 trace_start;
+
+	if (maliBltJobDone(blt, blt->last_job))
+		return;
+
+	if (blt->threaded)
+	{
+		maliBltWait(blt, blt->last_job);
+		return;
+	}
+
+	trace_start = MALI_TRACE_BEGIN(blt->trace);
+	blt->waits++;
+
+	(void)blt_synch(blt->handle, 0);
+	pthread_mutex_lock(&blt->lock);
+	maliBltRetire(blt, blt->last_job);
+	pthread_mutex_unlock(&blt->lock);
+
+	MALI_TRACE_END(blt->trace, MALI_TRACE_BLT_WAIT, trace_start, blt->last_job, 0);
+}
+
+/* Blits submitted to a channel and not yet seen complete */
+unsigned int maliBltPending( MaliBltPtr blt )
+{
+	return (blt->last_job - MALI_BLT_LOAD(blt->retired_job)) / MALI_BLT_MAX_CHANNELS;
+}
+
+Bool maliBltSchedOpen( MaliBltSchedPtr sched, int channels, Bool video, Bool threaded, int window )
+{
+	int i;
+
+	memset(sched, 0, sizeof(*sched));
+
+	if (channels < 1)
+		channels = 1;
+	if (channels > MALI_BLT_MAX_CHANNELS)
+		channels = MALI_BLT_MAX_CHANNELS;
+
+	for (i = 0; i < channels; i++)
+	{
+		if (!maliBltOpen(&sched->channel[i], i, threaded, window))
+			break;
+	}
+
+	if (i == 0)
+		return FALSE;
+
+	/* fewer handles than asked for still work, with less parallelism */
+	sched->num_channels = i;
+	sched->num_ui = video && i > 1 ? i - 1 : i;
+
+	return TRUE;
+}
+
+void maliBltSchedClose( MaliBltSchedPtr sched )
+{
+	int i;
+
+	for (i = 0; i < sched->num_channels; i++)
+		maliBltClose(&sched->channel[i]);
+
+	sched->num_channels = 0;
+}
+
+/* Make job, if still pending, complete before anything later on channel */
+void maliBltSchedOrder( MaliBltSchedPtr sched, MaliBltPtr channel, MaliBltJob job )
+{
+	if (maliBltSchedJobDone(sched, job) || MALI_BLT_JOB_CHANNEL(job) == channel->index)
+		return;
+
+	sched->cross_waits++;
+	maliBltWait(&sched->channel[MALI_BLT_JOB_CHANNEL(job)], job);
+}
+
+/*
+ * Channel for an operation depending on deps. A pending dependency pins
+ * the operation to its channel; without one the least busy channel is
+ * taken. Dependencies pending on other channels are waited for.
+ */
+MaliBltPtr maliBltSchedPick( MaliBltSchedPtr sched, const MaliBltJob *deps, int num_deps )
+{
+	MaliBltPtr channel = NULL;
+	int i;
+
+	for (i = 0; i < num_deps && !channel; i++)
+	{
+		if (!maliBltSchedJobDone(sched, deps[i]))
+			channel = &sched->channel[MALI_BLT_JOB_CHANNEL(deps[i])];
+	}
+
+	if (!channel)
+	{
+		channel = &sched->channel[0];
+		for (i = 1; i < sched->num_ui; i++)
+		{
+			if (maliBltPending(&sched->channel[i]) < maliBltPending(channel))
+				channel = &sched->channel[i];
+		}
+	}
+
+	for (i = 0; i < num_deps; i++)
+		maliBltSchedOrder(sched, channel, deps[i]);
+
+	return channel;
+}
+
+MaliBltPtr maliBltSchedVideo( MaliBltSchedPtr sched )
+{
+	return &sched->channel[sched->num_channels - 1];
+}
+
+Bool maliBltSchedJobDone( MaliBltSchedPtr sched, MaliBltJob job )
+{
+	return job == 0 || maliBltJobDone(&sched->channel[MALI_BLT_JOB_CHANNEL(job)], job);
+}
+
+void maliBltSchedWait( MaliBltSchedPtr sched, MaliBltJob job )
+{
+	if (job)
+		maliBltWait(&sched->channel[MALI_BLT_JOB_CHANNEL(job)], job);
+}
+
+void maliBltSchedWaitAll( MaliBltSchedPtr sched )
+{
+	int i;
+
+	for (i = 0; i < sched->num_channels; i++)
+		maliBltWaitAll(&sched->channel[i]);
+}
+
+/* Sum of the statistics of all channels */
+void maliBltSchedStats( MaliBltSchedPtr sched, MaliBltPtr total )
+{
+	int i, cls;
+
+	memset(total, 0, sizeof(*total));
+
+	for (i = 0; i < sched->num_channels; i++)
+	{
+		MaliBltPtr blt = &sched->channel[i];
+
+		total->submitted += blt->submitted;
+		total->failed += __atomic_load_n(&blt->failed, __ATOMIC_RELAXED);
+		total->waits += blt->waits;
+		total->bytes += blt->bytes;
+		total->stalls += __atomic_load_n(&blt->stalls, __ATOMIC_RELAXED);
+		total->stall_ns += __atomic_load_n(&blt->stall_ns, __ATOMIC_RELAXED);
+
+		for (cls = 0; cls < MALI_BLT_NUM_CLASSES; cls++)
+		{
+			MaliBltLatency *latency = &blt->latency[cls];
+			CARD64 queue_max_ns = __atomic_load_n(&latency->queue_max_ns, __ATOMIC_RELAXED);
+
+			total->latency[cls].jobs += __atomic_load_n(&latency->jobs, __ATOMIC_RELAXED);
+			total->latency[cls].queue_ns += __atomic_load_n(&latency->queue_ns, __ATOMIC_RELAXED);
+			total->latency[cls].complete_ns += __atomic_load_n(&latency->complete_ns, __ATOMIC_RELAXED);
+			if (queue_max_ns > total->latency[cls].queue_max_ns)
+				total->latency[cls].queue_max_ns = queue_max_ns;
+		}
+	}
+}
+
+void maliBltSchedSetPriorities( MaliBltSchedPtr sched, const int *prio )
+{
+	int i;
+
+	for (i = 0; i < sched->num_channels; i++)
+		memcpy(sched->channel[i].prio, prio, sizeof(sched->channel[i].prio));
+}
+
+const char *maliBltClassName( MaliBltClass cls )
+{
+	return maliBltClassNames[cls];
+}
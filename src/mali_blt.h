@@ -0,0 +1,188 @@
+/*
+ * Copyright (C) ST-Ericsson SA 2011
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef _MALI_BLT_H_
+#define _MALI_BLT_H_
+
+#include <pthread.h>
+#include "xf86.h"
+#include <blt_api.h>
+#include "mali_trace.h"
+
+/* Number of submitted blits tracked until they are known to be complete */
+#define MALI_BLT_MAX_INFLIGHT 64
+
+/* Polling interval bounds while the blitter is busy with other clients */
+#define MALI_BLT_BACKOFF_MIN_US 50
+#define MALI_BLT_BACKOFF_MAX_US 4000
+
+/* Requests queued for the submission thread, a power of two */
+#define MALI_BLT_QUEUE_SIZE 64
+
+/* libblt_hw handles driven in parallel, a power of two */
+#define MALI_BLT_MAX_CHANNELS 4
+#define MALI_BLT_CHANNELS_DEFAULT 2
+
+/* Kinds of work, each submitted with a priority of its own */
+typedef enum
+{
+	MALI_BLT_CLASS_XV,		/* video frames */
+	MALI_BLT_CLASS_DRI2,		/* swap copies */
+	MALI_BLT_CLASS_FILL,		/* EXA solid fills */
+	MALI_BLT_CLASS_COPY,		/* EXA copies and composites */
+	MALI_BLT_CLASS_UPLOAD,		/* EXA uploads and downloads */
+	MALI_BLT_NUM_CLASSES
+} MaliBltClass;
+
+/* Request priorities of the classes, higher is more urgent */
+#define MALI_BLT_PRIO_MIN -20
+#define MALI_BLT_PRIO_MAX 19
+#define MALI_BLT_PRIO_XV_DEFAULT 4
+#define MALI_BLT_PRIO_DRI2_DEFAULT 2
+#define MALI_BLT_PRIO_FILL_DEFAULT 0
+#define MALI_BLT_PRIO_COPY_DEFAULT 0
+#define MALI_BLT_PRIO_UPLOAD_DEFAULT 1
+
+/*
+ * Driver side sequence number of a submitted blit. The low bits hold the
+ * channel the blit went to, 0 never names a job. 64 bits never wrap, so a
+ * job left on a pixmap for any length of time still compares as done.
+ */
+typedef CARD64 MaliBltJob;
+
+#define MALI_BLT_JOB_CHANNEL( job ) ((job) & (MALI_BLT_MAX_CHANNELS - 1))
+
+/* TRUE if job a was submitted after job b of the same channel */
+#define MALI_BLT_JOB_AFTER( a, b ) ((a) > (b))
+
+typedef struct
+{
+	MaliBltJob job;
+	int request_id;		/* -1 if libblt_hw rejected the request */
+	MaliBltClass cls;
+	CARD64 submit_ns;	/* when maliBltSubmit was called */
+} MaliBltInflight;
+
+typedef struct
+{
+	MaliBltJob job;
+	MaliBltClass cls;
+	CARD64 submit_ns;
+	struct blt_req req;
+} MaliBltQueued;
+
+/*
+ * Latency of the blits of one class, updated by whoever issues and
+ * retires them. Queue time runs until libblt_hw accepted the request,
+ * completion time until the driver saw it complete.
+ */
+typedef struct
+{
+	unsigned long jobs;
+	CARD64 queue_ns;
+	CARD64 queue_max_ns;
+	CARD64 complete_ns;
+} MaliBltLatency;
+
+/*
+ * Without a submission thread everything runs in the server thread. With
+ * one, the server only fills the request queue, the submission thread
+ * issues requests and the completion thread waits for them. The threads
+ * share the in-flight table under lock. The server shares nothing else
+ * with them but the queue and the fields marked below, which are only
+ * accessed atomically.
+ */
+typedef struct
+{
+	int index;		/* channel number, in the low bits of its jobs */
+	int handle;
+	MaliBltJob last_job;
+	MaliBltJob retired_job;		/* shared */
+	pthread_mutex_t lock;		/* guards the in-flight table */
+	pthread_cond_t inflight_cond;	/* jobs went in flight, or quit */
+	MaliBltInflight inflight[MALI_BLT_MAX_INFLIGHT];
+	int inflight_first;
+	int num_inflight;
+	int window;		/* in flight at most, up to MALI_BLT_MAX_INFLIGHT */
+	int prio[MALI_BLT_NUM_CLASSES];
+	MaliTracePtr trace;
+
+	/* submission thread */
+	Bool threaded;
+	pthread_t thread;
+	pthread_t completion_thread;
+	MaliBltQueued queue[MALI_BLT_QUEUE_SIZE];
+	unsigned int queue_head;	/* shared, advanced by the server */
+	unsigned int queue_tail;	/* shared, advanced by the thread */
+	int thread_idle;		/* shared, thread sleeps on kick_fd */
+	int server_waiting;		/* shared, server sleeps on done_fd */
+	int quit;			/* shared */
+	int kick_fd;
+	int done_fd;
+
+	/* statistics */
+	unsigned long submitted;
+	unsigned long failed;		/* shared */
+	int failed_errno;		/* shared, of the last failure */
+	unsigned long failed_logged;
+	unsigned long waits;
+	unsigned long stalls;		/* shared, submissions that had to wait */
+	CARD64 stall_ns;		/* shared */
+	CARD64 bytes;		/* destination bytes written */
+	MaliBltLatency latency[MALI_BLT_NUM_CLASSES];	/* shared */
+} MaliBltRec, *MaliBltPtr;
+
+/*
+ * Channels 0 to num_ui - 1 take EXA work, the channels after them are
+ * reserved for video. Work on one pixmap stays on one channel while any
+ * of it is pending, which keeps it in order; independent work goes to
+ * the least busy channel.
+ */
+typedef struct
+{
+	MaliBltRec channel[MALI_BLT_MAX_CHANNELS];
+	int num_channels;
+	int num_ui;
+	unsigned long cross_waits;	/* dependencies on another channel waited for */
+} MaliBltSchedRec, *MaliBltSchedPtr;
+
+Bool maliBltOpen( MaliBltPtr blt, int index, Bool threaded, int window );
+void maliBltClose( MaliBltPtr blt );
+MaliBltJob maliBltSubmit( MaliBltPtr blt, struct blt_req *req, MaliBltClass cls );
+Bool maliBltJobDone( MaliBltPtr blt, MaliBltJob job );
+void maliBltWait( MaliBltPtr blt, MaliBltJob job );
+void maliBltWaitAll( MaliBltPtr blt );
+unsigned int maliBltPending( MaliBltPtr blt );
+
+Bool maliBltSchedOpen( MaliBltSchedPtr sched, int channels, Bool video, Bool threaded, int window );
+void maliBltSchedClose( MaliBltSchedPtr sched );
+MaliBltPtr maliBltSchedPick( MaliBltSchedPtr sched, const MaliBltJob *deps, int num_deps );
+MaliBltPtr maliBltSchedVideo( MaliBltSchedPtr sched );
+void maliBltSchedOrder( MaliBltSchedPtr sched, MaliBltPtr channel, MaliBltJob job );
+Bool maliBltSchedJobDone( MaliBltSchedPtr sched, MaliBltJob job );
+void maliBltSchedWait( MaliBltSchedPtr sched, MaliBltJob job );
+void maliBltSchedWaitAll( MaliBltSchedPtr sched );
+void maliBltSchedStats( MaliBltSchedPtr sched, MaliBltPtr total );
+void maliBltSchedSetPriorities( MaliBltSchedPtr sched, const int *prio );
+const char *maliBltClassName( MaliBltClass cls );
+
+#endif /* _MALI_BLT_H_ */
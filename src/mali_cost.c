@@ -0,0 +1,230 @@
+/*
+ * Copyright (C) ST-Ericsson SA 2011
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Cost model for choosing between the blitter and the CPU.
+ *
+ * Each operation has a fixed cost on the blitter, mostly the ioctl round
+ * trip of blt_request, and a cost per byte the blitter streams through.
+ * The CPU has no fixed cost to speak of but pays per scanline and per
+ * byte. The calibration times a few shapes on both and fits the model;
+ * CPU operations keep refining the fixed CPU cost as they run, since that
+ * is where access preparation and cache maintenance end up.
+ *
+ * Models are saved and loaded as "cost_<operation>_<field>=value" lines,
+ * the format of the _MALI_STATS property.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "mali_cost.h"
+
+/* Largest square side tried when looking for the crossover */
+#define MALI_COST_MAX_SIDE 2048
+
+static const char *maliCostKernelNames[MALI_COST_NUM_KERNELS] = { "fill", "copy" };
+
+typedef struct
+{
+	const char *name;
+	size_t offset;
+} MaliCostField;
+
+static const MaliCostField maliCostFields[] = {
+	{ "hw_op_ns", offsetof(MaliCostModel, hw_op_ns) },
+	{ "hw_byte_ps", offsetof(MaliCostModel, hw_byte_ps) },
+	{ "cpu_op_ns", offsetof(MaliCostModel, cpu_op_ns) },
+	{ "cpu_row_ns", offsetof(MaliCostModel, cpu_row_ns) },
+	{ "cpu_byte_ps", offsetof(MaliCostModel, cpu_byte_ps) },
+};
+
+#define MALI_COST_NUM_FIELDS (sizeof(maliCostFields) / sizeof(maliCostFields[0]))
+
+static CARD32 *maliCostField( MaliCostModel *model, int field )
+{
+	return (CARD32 *)((char *)model + maliCostFields[field].offset);
+}
+
+static CARD32 maliCostClamp( long long value )
+{
+	return value < 0 ? 0 : value > 0xffffffffLL ? 0xffffffff : (CARD32)value;
+}
+
+/*
+ * Fit a model to the calibration samples: small, large and tall, where
+ * the tall one has as many scanlines as the large one. Large against tall
+ * gives the cost per byte, tall against small the cost per scanline, and
+ * what the small one costs beyond that is fixed.
+ */
+void maliCostFit( MaliCostModel *model, const MaliCostSample *samples )
+{
+	const MaliCostSample *small = &samples[0], *large = &samples[1], *tall = &samples[2];
+	long long byte_ps, row_ns;
+
+	byte_ps = ((long long)large->hw_ns - (long long)small->hw_ns) * 1000 / (large->bytes - small->bytes);
+	model->hw_byte_ps = maliCostClamp(byte_ps);
+	model->hw_op_ns = maliCostClamp((long long)small->hw_ns - (long long)small->bytes * model->hw_byte_ps / 1000);
+
+	byte_ps = ((long long)large->cpu_ns - (long long)tall->cpu_ns) * 1000 / (large->bytes - tall->bytes);
+	model->cpu_byte_ps = maliCostClamp(byte_ps);
+	row_ns = ((long long)tall->cpu_ns - (long long)small->cpu_ns -
+		  (long long)(tall->bytes - small->bytes) * model->cpu_byte_ps / 1000) / (tall->rows - small->rows);
+	model->cpu_row_ns = maliCostClamp(row_ns);
+	model->cpu_op_ns = maliCostClamp((long long)small->cpu_ns - (long long)small->rows * model->cpu_row_ns -
+					 (long long)small->bytes * model->cpu_byte_ps / 1000);
+}
+
+CARD64 maliCostHw( const MaliCostModel *model, int rows, int bytes )
+{
+	return model->hw_op_ns + (CARD64)bytes * model->hw_byte_ps / 1000;
+}
+
+CARD64 maliCostCpu( const MaliCostModel *model, int rows, int bytes )
+{
+	return model->cpu_op_ns + (CARD64)rows * model->cpu_row_ns + (CARD64)bytes * model->cpu_byte_ps / 1000;
+}
+
+/* Move the fixed CPU cost an eighth of the way towards the time ops
+ * operations over rows scanlines and bytes bytes took together */
+void maliCostCpuMeasured( MaliCostModel *model, int ops, int rows, int bytes, CARD64 ns )
+{
+	long long error = (long long)ns - (long long)maliCostCpu(model, rows, bytes) - (long long)(ops - 1) * model->cpu_op_ns;
+
+	model->cpu_op_ns = maliCostClamp((long long)model->cpu_op_ns + error / ops / 8);
+}
+
+/* Pixels of the largest square the CPU does faster, 0 if none */
+int maliCostCrossover( const MaliCostModel *model, int cpp )
+{
+	int side;
+
+	for (side = 1; side <= MALI_COST_MAX_SIDE; side++)
+	{
+		if (maliCostCpu(model, side, side * side * cpp) >= maliCostHw(model, side, side * side * cpp))
+			break;
+	}
+
+	return (side - 1) * (side - 1);
+}
+
+/* All models, FALSE unless the file sets every field */
+Bool maliCostLoad( MaliCostPtr cost, const char *file )
+{
+	MaliCostRec loaded;
+	char line[128], name[64];
+	unsigned int value, found = 0;
+	FILE *f;
+	unsigned int i;
+	int k;
+
+	f = fopen(file, "r");
+	if (!f)
+		return FALSE;
+
+	memset(&loaded, 0, sizeof(loaded));
+	while (fgets(line, sizeof(line), f))
+	{
+		if (sscanf(line, "cost_%63[^=]=%u", name, &value) != 2)
+			continue;
+
+		for (k = 0; k < MALI_COST_NUM_KERNELS; k++)
+		{
+			size_t len = strlen(maliCostKernelNames[k]);
+
+			if (strncmp(name, maliCostKernelNames[k], len) || name[len] != '_')
+				continue;
+
+			for (i = 0; i < MALI_COST_NUM_FIELDS; i++)
+			{
+				if (!strcmp(name + len + 1, maliCostFields[i].name))
+				{
+					*maliCostField(&loaded.model[k], i) = value;
+					found |= 1 << (k * MALI_COST_NUM_FIELDS + i);
+				}
+			}
+		}
+	}
+	fclose(f);
+
+	if (found != (1 << (MALI_COST_NUM_KERNELS * MALI_COST_NUM_FIELDS)) - 1)
+		return FALSE;
+
+	*cost = loaded;
+
+	return TRUE;
+}
+
+Bool maliCostSave( MaliCostPtr cost, const char *file )
+{
+	char text[1024];
+	FILE *f;
+	int fd;
+
+	/* as for trace dumps, never write through a link, make a new file */
+	unlink(file);
+	fd = open(file, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW, 0600);
+	f = fd >= 0 ? fdopen(fd, "w") : NULL;
+	if (!f)
+	{
+		if (fd >= 0)
+			close(fd);
+		return FALSE;
+	}
+
+	maliCostPrint(cost, text, sizeof(text));
+	fputs(text, f);
+
+	return fclose(f) == 0;
+}
+
+/* The models and the crossovers they imply, as "name=value" lines */
+int maliCostPrint( MaliCostPtr cost, char *buf, int size )
+{
+	int len = 0;
+	unsigned int i;
+	int k;
+
+	for (k = 0; k < MALI_COST_NUM_KERNELS; k++)
+	{
+		for (i = 0; i < MALI_COST_NUM_FIELDS; i++)
+			len += snprintf(buf + min(len, size), size - min(len, size), "cost_%s_%s=%u\n",
+					maliCostKernelNames[k], maliCostFields[i].name, *maliCostField(&cost->model[k], i));
+
+		len += snprintf(buf + min(len, size), size - min(len, size), "cost_%s_crossover_px=%d\n",
+				maliCostKernelNames[k], maliCostCrossover(&cost->model[k], 4));
+	}
+
+	return len;
+}
+
+const char *maliCostKernelName( MaliCostKernel kernel )
+{
+	return maliCostKernelNames[kernel];
+}
@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) ST-Ericsson SA 2011
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef _MALI_COST_H_
+#define _MALI_COST_H_
+
+#include "xf86.h"
+
+/* Operations both the blitter and the CPU can do */
+typedef enum
+{
+	MALI_COST_FILL,
+	MALI_COST_COPY,
+	MALI_COST_NUM_KERNELS
+} MaliCostKernel;
+
+/*
+ * Linear model of one operation: a fixed cost per operation, per scanline
+ * and per destination byte. Scanlines only count on the CPU, where every
+ * one starts a new run of cache lines; the blitter streams them.
+ */
+typedef struct
+{
+	CARD32 hw_op_ns;
+	CARD32 hw_byte_ps;
+	CARD32 cpu_op_ns;
+	CARD32 cpu_row_ns;
+	CARD32 cpu_byte_ps;
+} MaliCostModel;
+
+/* Timings of one shape, in ns per operation */
+typedef struct
+{
+	int rows;
+	int bytes;
+	CARD64 hw_ns;
+	CARD64 cpu_ns;
+} MaliCostSample;
+
+/* Shapes timed by the calibration, at 32 bpp: small, large, tall */
+#define MALI_COST_NUM_SAMPLES 3
+
+typedef struct
+{
+	MaliCostModel model[MALI_COST_NUM_KERNELS];
+} MaliCostRec, *MaliCostPtr;
+
+void maliCostFit( MaliCostModel *model, const MaliCostSample *samples );
+CARD64 maliCostHw( const MaliCostModel *model, int rows, int bytes );
+CARD64 maliCostCpu( const MaliCostModel *model, int rows, int bytes );
+void maliCostCpuMeasured( MaliCostModel *model, int ops, int rows, int bytes, CARD64 ns );
+int maliCostCrossover( const MaliCostModel *model, int cpp );
+Bool maliCostLoad( MaliCostPtr cost, const char *file );
+Bool maliCostSave( MaliCostPtr cost, const char *file );
+int maliCostPrint( MaliCostPtr cost, char *buf, int size );
+const char *maliCostKernelName( MaliCostKernel kernel );
+
+#endif /* _MALI_COST_H_ */
@@ -25,4 +25,5 @@
 #include "exa.h"
 
 Bool maliSetupExa( ScreenPtr pScreen, ExaDriverPtr exa, int xres, int yres, unsigned char *virt );
+void maliCloseExa( ScreenPtr pScreen );
 #endif
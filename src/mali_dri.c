@@ -29,6 +29,8 @@
 #include <errno.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include "dixstruct.h"
+#include "damage.h"
 #include "mali_dri.h"
 
 #define IGNORE( a ) ( a = a )
@@ -40,8 +42,166 @@ typedef struct
 	PixmapPtr pPixmap;
 	unsigned int attachment;
 	Bool isPageFlipped;
+	unsigned int age;	/* swaps since the contents were presented, 0 if they never were */
 } MaliDRI2BufferPrivateRec, *MaliDRI2BufferPrivatePtr;
 
+/* Byte offset of a slice of the virtual framebuffer */
+#define MALI_DRI2_SLICE_OFFSET( fPtr, slice ) \
+	((fPtr)->fb_lcd_var.xres_virtual * (fPtr)->fb_lcd_var.bits_per_pixel/8 * (fPtr)->fb_lcd_var.yres * (slice))
+
+/*
+ * With DRI2_BUFFER_AGE the top bits of the buffer flags carry the age of the
+ * buffer, the bits below stay the offset of flipped buffers. An age too
+ * large to fit is left out, which reads as contents the client cannot use.
+ */
+#define MALI_DRI2_FLAGS_AGE_SHIFT 28
+#define MALI_DRI2_FLAGS_AGE_MAX 15
+
+/* Swap completion types of DRI2 start at 1, a client blocked in WaitMSC is queued as 0 */
+#define MALI_DRI2_WAIT_MSC 0
+
+/*
+ * A swap or WaitMSC waiting for its vblank. Flips are handed to the display
+ * one at a time, the vblank before their target, and complete at once when
+ * the client has a free slice left, at the next vblank otherwise. Blits have
+ * been copied already and only wait for the client to be told, as do
+ * WaitMSC calls. Neither the drawable nor the client may live that long,
+ * so the drawable is looked up again at completion and the client is
+ * cleared if it leaves, which drops the event.
+ */
+typedef struct _MaliDRI2Swap
+{
+	struct _MaliDRI2Swap *next;
+	ClientPtr client;
+	XID drawable;
+	int type;
+	Bool issued;
+	CARD64 target_msc;
+	DRI2SwapEventPtr func;
+	void *data;
+	CARD64 trace_start;
+} MaliDRI2SwapRec, *MaliDRI2SwapPtr;
+
+#if DRI2INFOREC_VERSION >= 4
+static void MaliDRI2CompleteFlips( ScrnInfoPtr pScrn, DrawablePtr pDraw );
+#endif
+
+/*
+ * Back and fake front buffers released by their drawable are kept for a
+ * while, oldest first, and handed to the next buffer of the same size and
+ * format. Resizing windows and recreating EGL surfaces then reuse the hwmem
+ * they had instead of freeing and allocating it again. The buffer names
+ * went to the clients rendering to the drawable, which may still have them
+ * imported, so a buffer only ever goes back to the drawable it came from.
+ */
+static void MaliDRI2CacheRemove( MaliPtr fPtr, int i )
+{
+	fPtr->dri2_cached--;
+	memmove( &fPtr->dri2_cache[i], &fPtr->dri2_cache[i + 1], (fPtr->dri2_cached - i) * sizeof(fPtr->dri2_cache[0]) );
+}
+
+static CARD32 MaliDRI2CacheTimer( OsTimerPtr timer, CARD32 now, pointer arg )
+{
+	ScreenPtr pScreen = arg;
+	MaliPtr fPtr = MALIPTR(xf86Screens[pScreen->myNum]);
+
+	while ( fPtr->dri2_cached > 0 )
+	{
+		CARD32 idle = now - fPtr->dri2_cache[0].released;
+
+		if ( idle < (CARD32)fPtr->dri2_cache_age ) return fPtr->dri2_cache_age - idle;
+
+		(*pScreen->DestroyPixmap)( fPtr->dri2_cache[0].pPixmap );
+		MaliDRI2CacheRemove( fPtr, 0 );
+	}
+
+	return 0;
+}
+
+/* The most recently released pixmap matching the buffer, NULL if there is none */
+static PixmapPtr MaliDRI2CacheLookup( MaliPtr fPtr, DrawablePtr pDraw, unsigned int format )
+{
+	int depth = (format != 0) ? format : pDraw->depth;
+	int i;
+
+	for ( i = fPtr->dri2_cached - 1; i >= 0; i-- )
+	{
+		PixmapPtr pPixmap = fPtr->dri2_cache[i].pPixmap;
+
+		if ( fPtr->dri2_cache[i].drawable == pDraw->id &&
+		     pPixmap->drawable.width == pDraw->width && pPixmap->drawable.height == pDraw->height &&
+		     pPixmap->drawable.depth == depth && fPtr->dri2_cache[i].format == format )
+		{
+			MaliDRI2CacheRemove( fPtr, i );
+			fPtr->dri2_cache_hits++;
+
+			/* swaps out of it may still be reading */
+			maliPixmapWaitIdle( pPixmap );
+			return pPixmap;
+		}
+	}
+
+	fPtr->dri2_cache_misses++;
+	return NULL;
+}
+
+/* Keep the pixmap of a released buffer, FALSE if it is to be destroyed */
+static Bool MaliDRI2CacheInsert( DrawablePtr pDraw, MaliPtr fPtr, PixmapPtr pPixmap, unsigned int format )
+{
+	ScreenPtr pScreen = pDraw->pScreen;
+	ScrnInfoPtr pScrn = xf86Screens[pScreen->myNum];
+	MaliDRI2CachedBufferRec *entry;
+
+	if ( 0 == fPtr->dri2_cache_size || 1 != pPixmap->refcnt ) return FALSE;
+
+	if ( fPtr->dri2_cached == fPtr->dri2_cache_size )
+	{
+		(*pScreen->DestroyPixmap)( fPtr->dri2_cache[0].pPixmap );
+		MaliDRI2CacheRemove( fPtr, 0 );
+	}
+
+	entry = &fPtr->dri2_cache[fPtr->dri2_cached++];
+	entry->pPixmap = pPixmap;
+	entry->drawable = pDraw->id;
+	entry->format = format;
+	entry->released = GetTimeInMillis();
+
+	/* the timer runs for the oldest entry, and only the first one arms it */
+	if ( 1 == fPtr->dri2_cached )
+	{
+		fPtr->dri2_cache_timer = TimerSet( fPtr->dri2_cache_timer, 0, fPtr->dri2_cache_age, MaliDRI2CacheTimer, pScreen );
+		if ( NULL == fPtr->dri2_cache_timer )
+		{
+			xf86DrvMsg( pScrn->scrnIndex, X_WARNING, "[%s:%d] failed to set up the DRI2 buffer cache timer\n", __FUNCTION__, __LINE__ );
+			MaliDRI2CacheRemove( fPtr, 0 );
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+void MaliDRI2FlushBufferCache( ScreenPtr pScreen )
+{
+	ScrnInfoPtr pScrn = xf86Screens[pScreen->myNum];
+	MaliPtr fPtr = MALIPTR(pScrn);
+
+	while ( fPtr->dri2_cached > 0 )
+	{
+		(*pScreen->DestroyPixmap)( fPtr->dri2_cache[0].pPixmap );
+		MaliDRI2CacheRemove( fPtr, 0 );
+	}
+
+	if ( NULL != fPtr->dri2_cache_timer ) TimerCancel( fPtr->dri2_cache_timer );
+}
+
+static unsigned int MaliDRI2Flags( MaliPtr fPtr, unsigned int offset, unsigned int age )
+{
+	if ( !fPtr->dri2_buffer_age || age > MALI_DRI2_FLAGS_AGE_MAX ) return offset;
+
+	return offset | (age << MALI_DRI2_FLAGS_AGE_SHIFT);
+}
+
 static DRI2Buffer2Ptr MaliDRI2CreateBuffer( DrawablePtr pDraw, unsigned int attachment, unsigned int format )
 {
 	ScreenPtr pScreen = pDraw->pScreen;
@@ -66,6 +226,7 @@ static DRI2Buffer2Ptr MaliDRI2CreateBuffer( DrawablePtr pDraw, unsigned int atta
 	privates->pPixmap = NULL;
 	privates->attachment = attachment;
 	privates->isPageFlipped = FALSE;
+	privates->age = 0;
 
 	/* initialize buffer info to default values */
 	buffer->attachment = attachment;
@@ -84,6 +245,9 @@ static DRI2Buffer2Ptr MaliDRI2CreateBuffer( DrawablePtr pDraw, unsigned int atta
 			return NULL;
 		}
 
+		fPtr->flip_slices = fPtr->fb_lcd_var.yres_virtual / fPtr->fb_lcd_var.yres;
+		if ( fPtr->flip_slices > fPtr->flip_buffers ) fPtr->flip_slices = fPtr->flip_buffers;
+
 		secure_id = ioctl(fPtr->fb_lcd_fd, MCDE_GET_BUFFER_NAME_IOC, NULL);
 
 		if ( -1 == secure_id )
@@ -101,13 +265,21 @@ static DRI2Buffer2Ptr MaliDRI2CreateBuffer( DrawablePtr pDraw, unsigned int atta
 		{
 			/* Use the "flags" attribute in order to provide EGL with enough information to offset the provided UMP memory for this buffer
 			 * Flags will only be set in cases where it is possible to do page flipping instead of offscreen rendering with EXA copy
-			 * Offset is set to the second virtual screen, in y direction
+			 * Offset is set to the virtual screen the client renders into next, in y direction, starting with the second
 			 * Example: 
 			 * Physical resolution: 1366 x 768 
 			 * Virtual resolution:  1366 x 1536
 			 * Offset: 768
+			 * Every flip moves it on to a slice neither shown nor waiting to be, see MaliDRI2Flip
 			 */
-			buffer->flags = (fPtr->fb_lcd_var.xres_virtual * fPtr->fb_lcd_var.bits_per_pixel/8) * fPtr->fb_lcd_var.yres;
+			fPtr->flip_scanout = 0;
+			fPtr->flip_queued = -1;
+			fPtr->flip_back = 1;
+			fPtr->flip_back_flags = &buffer->flags;
+			fPtr->flip_back_age = &privates->age;
+			fPtr->flip_frame = 0;
+			memset( fPtr->flip_slice_frame, 0, sizeof(fPtr->flip_slice_frame) );
+			buffer->flags = MaliDRI2Flags( fPtr, MALI_DRI2_SLICE_OFFSET( fPtr, fPtr->flip_back ), 0 );
 	
 			/* make sure the display offset is set to a known state */
 			if ( ioctl( fPtr->fb_lcd_fd, FBIOGET_VSCREENINFO, &fPtr->fb_lcd_var ) < 0 )
@@ -118,7 +290,7 @@ static DRI2Buffer2Ptr MaliDRI2CreateBuffer( DrawablePtr pDraw, unsigned int atta
 				return NULL;
 			}
 
-			fPtr->fb_lcd_var.yoffset = fPtr->fb_lcd_var.yres;
+			fPtr->fb_lcd_var.yoffset = 0;
 			fPtr->fb_lcd_var.activate = FB_ACTIVATE_NOW;
 
 			if ( ioctl( fPtr->fb_lcd_fd, FBIOPUT_VSCREENINFO, &fPtr->fb_lcd_var ) < 0 )
@@ -135,6 +307,9 @@ static DRI2Buffer2Ptr MaliDRI2CreateBuffer( DrawablePtr pDraw, unsigned int atta
 
 		privates->isPageFlipped = TRUE;
 
+		/* the client renders into the framebuffer, the CPU must resync on access */
+		maliPixmapEnsureHwmem( pPixmap );
+
 		pPixmap->refcnt++;
 
 		buffer->pitch = pPixmap->devKind;
@@ -144,7 +319,7 @@ static DRI2Buffer2Ptr MaliDRI2CreateBuffer( DrawablePtr pDraw, unsigned int atta
 			buffer->pitch = ( (pPixmap->drawable.width*pPixmap->drawable.bitsPerPixel) + 7 ) / 8;
 		}
 		buffer->cpp = pPixmap->drawable.bitsPerPixel / 8;
-		xf86DrvMsg( pScrn->scrnIndex, X_ERROR, "[%s:%d] Enabled Page Flipping (pitch: %i flags: %i width: %i height: %i)\n", __FUNCTION__, __LINE__, buffer->pitch, buffer->flags, pPixmap->drawable.width, pPixmap->drawable.height );
+		xf86DrvMsg( pScrn->scrnIndex, X_ERROR, "[%s:%d] Enabled Page Flipping (pitch: %i flags: %i width: %i height: %i buffers: %i)\n", __FUNCTION__, __LINE__, buffer->pitch, buffer->flags, pPixmap->drawable.width, pPixmap->drawable.height, fPtr->flip_slices );
 
 		ioctl( fPtr->fb_lcd_fd, FBIOGET_VSCREENINFO, &fPtr->fb_lcd_var );
 	}
@@ -159,20 +334,33 @@ static DRI2Buffer2Ptr MaliDRI2CreateBuffer( DrawablePtr pDraw, unsigned int atta
 		}
 		else
 		{
-			/* create a new pixmap for the offscreen data */
-			pPixmap = (*pScreen->CreatePixmap)( pScreen, pDraw->width, pDraw->height, (format != 0) ? format : pDraw->depth, 0 );
+			/* reuse a released pixmap or create a new one for the offscreen data */
+			pPixmap = MaliDRI2CacheLookup( fPtr, pDraw, format );
 			if ( NULL == pPixmap )
 			{
-				xf86DrvMsg( pScrn->scrnIndex, X_ERROR, "[%s:%d] unable to allocate pixmap\n", __FUNCTION__, __LINE__ );
-				free( buffer );
-				free( privates );
-				return NULL;
-			}
+				pPixmap = (*pScreen->CreatePixmap)( pScreen, pDraw->width, pDraw->height, (format != 0) ? format : pDraw->depth, 0 );
+				if ( NULL == pPixmap )
+				{
+					xf86DrvMsg( pScrn->scrnIndex, X_ERROR, "[%s:%d] unable to allocate pixmap\n", __FUNCTION__, __LINE__ );
+					free( buffer );
+					free( privates );
+					return NULL;
+				}
 
-			exaMoveInPixmap(pPixmap);
+				exaMoveInPixmap(pPixmap);
+			}
 		}
 
 		privates->pPixmap = pPixmap;
+		if ( !maliPixmapEnsureHwmem( pPixmap ) )
+		{
+			xf86DrvMsg( pScrn->scrnIndex, X_ERROR, "[%s:%d] pixmap has no hwmem buffer\n", __FUNCTION__, __LINE__ );
+			(*pScreen->DestroyPixmap)( pPixmap );
+			free( buffer );
+			free( privates );
+			return NULL;
+		}
+
 		privPixmap = (PrivPixmap *)exaGetPixmapDriverPrivate( pPixmap );
 		buffer->pitch = pPixmap->devKind;
 		buffer->cpp = pPixmap->drawable.bitsPerPixel / 8;
@@ -197,6 +385,14 @@ static void MaliDRI2DestroyBuffer( DrawablePtr pDraw, DRI2Buffer2Ptr buffer )
 		{
 			if ( TRUE == private->isPageFlipped )
 			{
+				if ( fPtr->flip_back_flags == &buffer->flags ) fPtr->flip_back_flags = NULL;
+				if ( fPtr->flip_back_age == &private->age ) fPtr->flip_back_age = NULL;
+				fPtr->flip_scanout = 0;
+				fPtr->flip_queued = -1;
+#if DRI2INFOREC_VERSION >= 4
+				MaliDRI2CompleteFlips( pScrn, pDraw );
+#endif
+
 				xf86DrvMsg( pScrn->scrnIndex, X_ERROR, "[%s:%d] Setting back to zero offset\n", __FUNCTION__, __LINE__ );
 				fPtr->fb_lcd_var.yoffset = 0;
 				fPtr->fb_lcd_var.activate = FB_ACTIVATE_NOW;
@@ -206,7 +402,15 @@ static void MaliDRI2DestroyBuffer( DrawablePtr pDraw, DRI2Buffer2Ptr buffer )
 					xf86DrvMsg( pScrn->scrnIndex, X_WARNING, "[%s:%d] failed in FBIOPUT_VSCREENINFO\n", __FUNCTION__, __LINE__ );
 				}
 			}
-			if( NULL != private->pPixmap ) (*pScreen->DestroyPixmap)(private->pPixmap);
+			if ( NULL != private->pPixmap )
+			{
+				Bool cached = FALSE;
+
+				if ( FALSE == private->isPageFlipped && DRI2BufferFrontLeft != private->attachment )
+					cached = MaliDRI2CacheInsert( pDraw, fPtr, private->pPixmap, buffer->format );
+
+				if ( FALSE == cached ) (*pScreen->DestroyPixmap)(private->pPixmap);
+			}
 		}
 
 		free( private );
@@ -214,10 +418,153 @@ static void MaliDRI2DestroyBuffer( DrawablePtr pDraw, DRI2Buffer2Ptr buffer )
 	}
 }
 
+/* A slice neither shown nor waiting to be, -1 when there is none */
+static int MaliDRI2FreeSlice( MaliPtr fPtr )
+{
+	int i;
+
+	for ( i = 1; i < fPtr->flip_slices; i++ )
+	{
+		int slice = (fPtr->flip_scanout + i) % fPtr->flip_slices;
+
+		if ( slice != fPtr->flip_queued ) return slice;
+	}
+
+	return -1;
+}
+
+/*
+ * Point the client at the slice it renders into next, it fetches its buffers
+ * again after every swap. The slice still holds the frame it last showed.
+ */
+static void MaliDRI2SetBack( MaliPtr fPtr, int slice )
+{
+	unsigned int age;
+
+	fPtr->flip_back = slice;
+	if ( slice < 0 ) return;
+
+	age = fPtr->flip_slice_frame[slice] ? fPtr->flip_frame - fPtr->flip_slice_frame[slice] + 1 : 0;
+	if ( NULL != fPtr->flip_back_age ) *fPtr->flip_back_age = age;
+	if ( NULL != fPtr->flip_back_flags ) *fPtr->flip_back_flags = MaliDRI2Flags( fPtr, MALI_DRI2_SLICE_OFFSET( fPtr, slice ), age );
+}
+
+/*
+ * Show the slice the client rendered. Synced flips are queued, shown from
+ * the vblank at msc, the others at once. The client gets the next free
+ * slice, which with two buffers only exists once a queued flip is up.
+ */
+static void MaliDRI2Flip( ScrnInfoPtr pScrn, Bool sync, CARD64 msc )
+{
+	MaliPtr fPtr = MALIPTR(pScrn);
+
+	if ( fPtr->flip_back < 0 ) return;
+
+	fPtr->fb_lcd_var.yoffset = fPtr->flip_back * fPtr->fb_lcd_var.yres;
+	fPtr->fb_lcd_var.activate = sync ? FB_ACTIVATE_VBL : FB_ACTIVATE_NOW;
+
+#if 1
+	if ( ioctl( fPtr->fb_lcd_fd, FBIOPUT_VSCREENINFO, &fPtr->fb_lcd_var ) < 0 )
+	{
+		xf86DrvMsg( pScrn->scrnIndex, X_WARNING, "[%s:%d] failed in FBIOPUT_VSCREENINFO (offset: %i)\n", __FUNCTION__, __LINE__, fPtr->fb_lcd_var.yoffset );
+	}
+#else
+	if ( ioctl( fPtr->fb_lcd_fd, FBIOPAN_DISPLAY, &fPtr->fb_lcd_var ) < 0 )
+	{
+		xf86DrvMsg( pScrn->scrnIndex, X_WARNING, "[%s:%d] failed in FBIOPAN_DISPLAY (offset: %i)\n", __FUNCTION__, __LINE__, fPtr->fb_lcd_var.yoffset );
+	}
+#endif
+	ioctl( fPtr->fb_lcd_fd, FBIOGET_VSCREENINFO, &fPtr->fb_lcd_var );
+
+	if ( sync )
+	{
+		fPtr->flip_queued = fPtr->flip_back;
+		fPtr->flip_msc = msc;
+	}
+	else
+	{
+		fPtr->flip_scanout = fPtr->flip_back;
+		fPtr->flip_queued = -1;
+	}
+
+	fPtr->flip_slice_frame[fPtr->flip_back] = ++fPtr->flip_frame;
+	MaliDRI2SetBack( fPtr, MaliDRI2FreeSlice( fPtr ) );
+}
+
+/* The queued slice is up, the one it replaced is free again */
+static void MaliDRI2FlipShown( MaliPtr fPtr )
+{
+	fPtr->flip_scanout = fPtr->flip_queued;
+	fPtr->flip_queued = -1;
+
+	if ( fPtr->flip_back < 0 ) MaliDRI2SetBack( fPtr, MaliDRI2FreeSlice( fPtr ) );
+}
+
+/* Pixmap behind a drawable, with the offset from drawable to pixmap coordinates */
+static PixmapPtr MaliDRI2DrawablePixmap( DrawablePtr pDraw, int *x, int *y )
+{
+	PixmapPtr pPixmap;
+
+	if ( DRAWABLE_PIXMAP == pDraw->type )
+	{
+		*x = 0;
+		*y = 0;
+		return (PixmapPtr)pDraw;
+	}
+
+	pPixmap = pDraw->pScreen->GetWindowPixmap( (WindowPtr)pDraw );
+#ifdef COMPOSITE
+	*x = pDraw->x - pPixmap->screen_x;
+	*y = pDraw->y - pPixmap->screen_y;
+#else
+	*x = pDraw->x;
+	*y = pDraw->y;
+#endif
+
+	return pPixmap;
+}
+
+/*
+ * Copy the boxes of pRegion, in drawable coordinates, straight between the
+ * hwmem buffers behind src and dst, as much as is visible of a window.
+ * Returns the pixels copied, -1 if the blitter cannot take the copy.
+ */
+static int MaliDRI2CopyBoxes( DrawablePtr pDraw, RegionPtr pRegion, DrawablePtr src, DrawablePtr dst )
+{
+	PixmapPtr pSrcPixmap, pDstPixmap;
+	int src_x, src_y, dst_x, dst_y, copied;
+	RegionRec region;
+
+	pSrcPixmap = MaliDRI2DrawablePixmap( src, &src_x, &src_y );
+	pDstPixmap = MaliDRI2DrawablePixmap( dst, &dst_x, &dst_y );
+
+	/* in screen coordinates for windows, like their clip list and damage */
+	REGION_INIT( pDraw->pScreen, &region, NullBox, 0 );
+	REGION_COPY( pDraw->pScreen, &region, pRegion );
+	REGION_TRANSLATE( pDraw->pScreen, &region, dst->x, dst->y );
+	if ( DRAWABLE_WINDOW == dst->type ) REGION_INTERSECT( pDraw->pScreen, &region, &region, &((WindowPtr)dst)->clipList );
+
+	REGION_TRANSLATE( pDraw->pScreen, &region, dst_x - dst->x, dst_y - dst->y );
+	maliExaSetDRI2Swap( TRUE );
+	copied = maliExaCopyBoxes( pSrcPixmap, pDstPixmap, REGION_RECTS( &region ), REGION_NUM_RECTS( &region ), src_x - dst_x, src_y - dst_y );
+	maliExaSetDRI2Swap( FALSE );
+
+	if ( copied > 0 )
+	{
+		REGION_TRANSLATE( pDraw->pScreen, &region, dst->x - dst_x, dst->y - dst_y );
+		DamageDamageRegion( dst, &region );
+	}
+
+	REGION_UNINIT( pDraw->pScreen, &region );
+
+	return copied;
+}
+
 static void MaliDRI2CopyRegion( DrawablePtr pDraw, RegionPtr pRegion, DRI2BufferPtr pDstBuffer, DRI2BufferPtr pSrcBuffer )
 {
 	GCPtr pGC;
 	RegionPtr copyRegion;
+	BoxPtr pExtents;
 	ScreenPtr pScreen = pDraw->pScreen;
 	MaliDRI2BufferPrivatePtr srcPrivate = pSrcBuffer->driverPrivate;
 	MaliDRI2BufferPrivatePtr dstPrivate = pDstBuffer->driverPrivate;
@@ -225,50 +572,332 @@ static void MaliDRI2CopyRegion( DrawablePtr pDraw, RegionPtr pRegion, DRI2Buffer
 	DrawablePtr dst = (dstPrivate->attachment == DRI2BufferFrontLeft) ? pDraw : &dstPrivate->pPixmap->drawable;
 	ScrnInfoPtr pScrn = xf86Screens[pScreen->myNum];
 	MaliPtr fPtr = MALIPTR(pScrn);
+	CARD64 trace_start = MALI_TRACE_BEGIN(&fPtr->trace);
+	int copied;
 
 	if ( TRUE == dstPrivate->isPageFlipped && TRUE == srcPrivate->isPageFlipped )
 	{
-		fPtr->fb_lcd_var.yoffset = (fPtr->fb_lcd_var.yoffset + fPtr->fb_lcd_var.yres) % (fPtr->fb_lcd_var.yres*2);
-
-
-#if 1
-		if ( ioctl( fPtr->fb_lcd_fd, FBIOPUT_VSCREENINFO, &fPtr->fb_lcd_var ) < 0 )
-		{
-			xf86DrvMsg( pScrn->scrnIndex, X_WARNING, "[%s:%d] failed in FBIOPUT_VSCREENINFO (offset: %i)\n", __FUNCTION__, __LINE__, fPtr->fb_lcd_var.yoffset );
-		}
+		MaliDRI2Flip( pScrn, FALSE, 0 );
 
+#if DRI2INFOREC_VERSION < 4
+		/* without ScheduleSwap there is no other way to keep clients to the refresh rate */
 		if ( fPtr->use_pageflipping_vsync )
 		{
-			fPtr->fb_lcd_var.activate = FB_ACTIVATE_VBL;
 			if ( ioctl( fPtr->fb_lcd_fd, FBIO_WAITFORVSYNC, 0 ) < 0 )
 			{
 				xf86DrvMsg( pScrn->scrnIndex, X_WARNING, "[%s:%d] failed in FBIO_WAITFORVSYNC\n", __FUNCTION__, __LINE__ );
 			}
 		}
-#else
-		if ( ioctl( fPtr->fb_lcd_fd, FBIOPAN_DISPLAY, &fPtr->fb_lcd_var ) < 0 )
-		{
-			xf86DrvMsg( pScrn->scrnIndex, X_WARNING, "[%s:%d] failed in FBIOPAN_DISPLAY (offset: %i)\n", __FUNCTION__, __LINE__, fPtr->fb_lcd_var.yoffset );
-		}
 #endif
-		ioctl( fPtr->fb_lcd_fd, FBIOGET_VSCREENINFO, &fPtr->fb_lcd_var );
 
+		MALI_TRACE_END( &fPtr->trace, MALI_TRACE_DRI2_FLIP, trace_start, fPtr->fb_lcd_var.yoffset, 0 );
 		return;
 	}
 
 	if ( DRI2BufferFakeFrontLeft == srcPrivate->attachment || DRI2BufferFakeFrontLeft == dstPrivate->attachment ) return;
 
-	pGC = GetScratchGC(pDraw->depth, pScreen);
+	copied = MaliDRI2CopyBoxes( pDraw, pRegion, src, dst );
+	if ( copied < 0 )
+	{
+		pGC = GetScratchGC(pDraw->depth, pScreen);
+
+		copyRegion = REGION_CREATE( pScreen, NULL, 0 );
+		REGION_COPY( pScreen, copyRegion, pRegion );
+		(*pGC->funcs->ChangeClip)(pGC, CT_REGION, copyRegion, 0 );
+		ValidateGC( dst, pGC );
+		maliExaSetDRI2Swap( TRUE );
+		(*pGC->ops->CopyArea)( src, dst, pGC, 0, 0, pDraw->width, pDraw->height, 0, 0 );
+		maliExaSetDRI2Swap( FALSE );
+
+		FreeScratchGC(pGC);
+
+		pExtents = REGION_EXTENTS( pScreen, pRegion );
+		copied = (pExtents->x2 - pExtents->x1) * (pExtents->y2 - pExtents->y1);
+	}
+
+	/* the client renders into the source again as soon as the swap returns */
+	if ( DRI2BufferFrontLeft != srcPrivate->attachment ) maliPixmapWaitIdle( srcPrivate->pPixmap );
+
+	/* a presented back buffer keeps its contents, they are the frame the client just finished */
+	if ( DRI2BufferBackLeft == srcPrivate->attachment && DRI2BufferFrontLeft == dstPrivate->attachment )
+	{
+		srcPrivate->age = 1;
+		pSrcBuffer->flags = MaliDRI2Flags( fPtr, 0, srcPrivate->age );
+	}
+
+	fPtr->dri2_copies++;
+	fPtr->dri2_copy_pixels += copied;
+	MALI_TRACE_END( &fPtr->trace, MALI_TRACE_DRI2_SWAP, trace_start, copied, 0 );
+}
+
+#if DRI2INFOREC_VERSION >= 4
+static void MaliDRI2SwapComplete( ScrnInfoPtr pScrn, MaliDRI2SwapPtr swap, CARD64 msc, CARD64 ust )
+{
+	MaliPtr fPtr = MALIPTR(pScrn);
+	DrawablePtr pDraw;
+
+	if ( MALI_DRI2_WAIT_MSC == swap->type )
+	{
+		if ( NULL != swap->client && Success == dixLookupDrawable( &pDraw, swap->drawable, serverClient, M_ANY, DixWriteAccess ) )
+		{
+			DRI2WaitMSCComplete( swap->client, pDraw, msc, ust / 1000000000, (ust % 1000000000) / 1000 );
+		}
+	}
+	/* DRI2 counts the swap as pending until told, even when its client has left */
+	else if ( Success == dixLookupDrawable( &pDraw, swap->drawable, serverClient, M_ANY, DixWriteAccess ) )
+	{
+		DRI2SwapComplete( swap->client, pDraw, msc, ust / 1000000000, (ust % 1000000000) / 1000, swap->type,
+		                  NULL != swap->client ? swap->func : NULL, swap->data );
+	}
+
+	if ( DRI2_FLIP_COMPLETE == swap->type ) MALI_TRACE_END( &fPtr->trace, MALI_TRACE_DRI2_FLIP, swap->trace_start, fPtr->fb_lcd_var.yoffset, 0 );
+
+	free( swap );
+}
+
+/*
+ * Complete what is due at msc and hand the next flip to the display once
+ * the previous one is up. A flip that leaves the client a free slice to
+ * render into completes as soon as it is queued, with the vblank it will
+ * show at, so the GPU need not idle while it waits for scanout.
+ */
+static void MaliDRI2SwapProcess( ScrnInfoPtr pScrn, CARD64 msc, CARD64 ust )
+{
+	MaliPtr fPtr = MALIPTR(pScrn);
+	MaliDRI2SwapPtr swap, *prev;
+
+	if ( fPtr->flip_queued >= 0 && msc >= fPtr->flip_msc ) MaliDRI2FlipShown( fPtr );
+
+	prev = &fPtr->swaps;
+	while ( NULL != (swap = *prev) )
+	{
+		if ( (swap->issued || DRI2_FLIP_COMPLETE != swap->type) && msc >= swap->target_msc )
+		{
+			*prev = swap->next;
+			MaliDRI2SwapComplete( pScrn, swap, msc, ust );
+			continue;
+		}
+		prev = &swap->next;
+	}
+
+	/* flips go to the display in order, one at a time */
+	prev = &fPtr->swaps;
+	while ( NULL != (swap = *prev) )
+	{
+		if ( DRI2_FLIP_COMPLETE == swap->type && !swap->issued )
+		{
+			if ( fPtr->flip_queued < 0 && fPtr->flip_back >= 0 && msc + 1 >= swap->target_msc )
+			{
+				MaliDRI2Flip( pScrn, TRUE, msc + 1 );
+				swap->issued = TRUE;
+				swap->target_msc = msc + 1;
+
+				if ( fPtr->flip_back >= 0 )
+				{
+					*prev = swap->next;
+					MaliDRI2SwapComplete( pScrn, swap, msc + 1, ust + fPtr->vblank.period );
+				}
+			}
+			break;
+		}
+		prev = &swap->next;
+	}
+
+	if ( NULL != fPtr->swaps || fPtr->flip_queued >= 0 ) maliVblankArm( &fPtr->vblank );
+}
+
+/*
+ * The flipped buffers of pDraw are going, flips of it not yet handed to
+ * the display never will be. They complete now, so that a drawable which
+ * stays is not left with swaps pending.
+ */
+static void MaliDRI2CompleteFlips( ScrnInfoPtr pScrn, DrawablePtr pDraw )
+{
+	MaliPtr fPtr = MALIPTR(pScrn);
+	MaliDRI2SwapPtr swap, *prev;
+	CARD64 msc, ust;
+
+	maliVblankQuery( &fPtr->vblank, &msc, &ust );
+
+	prev = &fPtr->swaps;
+	while ( NULL != (swap = *prev) )
+	{
+		if ( DRI2_FLIP_COMPLETE == swap->type && !swap->issued && swap->drawable == pDraw->id )
+		{
+			*prev = swap->next;
+			MaliDRI2SwapComplete( pScrn, swap, msc, ust );
+			continue;
+		}
+		prev = &swap->next;
+	}
+}
+
+/* OML_sync_control: a target already passed moves to the next msc where msc % divisor == remainder */
+static CARD64 MaliDRI2TargetMSC( CARD64 msc, CARD64 target_msc, CARD64 divisor, CARD64 remainder )
+{
+	if ( 0 == divisor || target_msc > msc ) return target_msc;
+
+	target_msc = msc - (msc % divisor) + remainder;
+	if ( target_msc <= msc ) target_msc += divisor;
+
+	return target_msc;
+}
+
+static MaliDRI2SwapPtr MaliDRI2QueueEvent( ScrnInfoPtr pScrn, ClientPtr client, DrawablePtr pDraw, int type, CARD64 target_msc )
+{
+	MaliPtr fPtr = MALIPTR(pScrn);
+	MaliDRI2SwapPtr swap, *tail;
+
+	swap = calloc( 1, sizeof *swap );
+	if ( NULL == swap )
+	{
+		xf86DrvMsg( pScrn->scrnIndex, X_ERROR, "[%s:%d] unable to allocate vblank event\n", __FUNCTION__, __LINE__ );
+		return NULL;
+	}
+
+	swap->client = client;
+	swap->drawable = pDraw->id;
+	swap->type = type;
+	swap->target_msc = target_msc;
+
+	for ( tail = &fPtr->swaps; NULL != *tail; tail = &(*tail)->next ) ;
+	*tail = swap;
+
+	return swap;
+}
+
+static void MaliDRI2Vblank( void *data, CARD64 msc, CARD64 ust )
+{
+	ScrnInfoPtr pScrn = data;
+	MaliPtr fPtr = MALIPTR(pScrn);
+
+	MALI_TRACE_INSTANT( &fPtr->trace, MALI_TRACE_VBLANK, msc, NULL != fPtr->swaps );
+
+	MaliDRI2SwapProcess( pScrn, msc, ust );
+}
+
+static void MaliDRI2ClientState( CallbackListPtr *list, pointer data, pointer args )
+{
+	ScrnInfoPtr pScrn = data;
+	MaliPtr fPtr = MALIPTR(pScrn);
+	ClientPtr client = ((NewClientInfoRec *)args)->client;
+	MaliDRI2SwapPtr swap;
+
+	if ( ClientStateGone != client->clientState && ClientStateRetained != client->clientState ) return;
+
+	for ( swap = fPtr->swaps; NULL != swap; swap = swap->next )
+	{
+		if ( swap->client == client ) swap->client = NULL;
+	}
+}
+
+/*
+ * Swaps between two page flipped buffers become flips, anything else is
+ * copied at once. With DRI2_WAIT_VSYNC the client hears of the swap at its
+ * target vblank, and flips happen at vblank, otherwise both complete here.
+ * The target follows the OML_sync_control rules for divisor and remainder.
+ */
+static int MaliDRI2ScheduleSwap( ClientPtr client, DrawablePtr pDraw, DRI2BufferPtr pDstBuffer, DRI2BufferPtr pSrcBuffer,
+                                 CARD64 *target_msc, CARD64 divisor, CARD64 remainder, DRI2SwapEventPtr func, void *data )
+{
+	ScreenPtr pScreen = pDraw->pScreen;
+	ScrnInfoPtr pScrn = xf86Screens[pScreen->myNum];
+	MaliPtr fPtr = MALIPTR(pScrn);
+	MaliDRI2BufferPrivatePtr srcPrivate = pSrcBuffer->driverPrivate;
+	MaliDRI2BufferPrivatePtr dstPrivate = pDstBuffer->driverPrivate;
+	Bool flip = TRUE == dstPrivate->isPageFlipped && TRUE == srcPrivate->isPageFlipped;
+	MaliDRI2SwapPtr swap;
+	CARD64 msc, ust;
+
+	if ( !flip )
+	{
+		BoxRec box;
+		RegionRec region;
+
+		box.x1 = 0;
+		box.y1 = 0;
+		box.x2 = pDraw->width;
+		box.y2 = pDraw->height;
+		REGION_INIT( pScreen, &region, &box, 0 );
+		MaliDRI2CopyRegion( pDraw, &region, pDstBuffer, pSrcBuffer );
+		REGION_UNINIT( pScreen, &region );
+		fPtr->dri2_blits++;
+	}
+	else fPtr->dri2_flips++;
+
+	maliVblankQuery( &fPtr->vblank, &msc, &ust );
+
+	if ( !fPtr->use_pageflipping_vsync )
+	{
+		if ( flip ) MaliDRI2Flip( pScrn, FALSE, 0 );
+		*target_msc = msc;
+		DRI2SwapComplete( client, pDraw, msc, ust / 1000000000, (ust % 1000000000) / 1000,
+		                  flip ? DRI2_FLIP_COMPLETE : DRI2_BLIT_COMPLETE, func, data );
+		return TRUE;
+	}
+
+	*target_msc = MaliDRI2TargetMSC( msc, *target_msc, divisor, remainder );
+
+	/* a flip shows at the earliest at the next vblank */
+	if ( flip && *target_msc <= msc ) *target_msc = msc + 1;
 
-	copyRegion = REGION_CREATE( pScreen, NULL, 0 );
-	REGION_COPY( pScreen, copyRegion, pRegion );
-	(*pGC->funcs->ChangeClip)(pGC, CT_REGION, copyRegion, 0 );
-	ValidateGC( dst, pGC );
-	(*pGC->ops->CopyArea)( src, dst, pGC, 0, 0, pDraw->width, pDraw->height, 0, 0 );
+	if ( !flip && *target_msc <= msc )
+	{
+		*target_msc = msc;
+		DRI2SwapComplete( client, pDraw, msc, ust / 1000000000, (ust % 1000000000) / 1000, DRI2_BLIT_COMPLETE, func, data );
+		return TRUE;
+	}
+
+	swap = MaliDRI2QueueEvent( pScrn, client, pDraw, flip ? DRI2_FLIP_COMPLETE : DRI2_BLIT_COMPLETE, *target_msc );
+	if ( NULL == swap ) return FALSE;
+
+	swap->func = func;
+	swap->data = data;
+	swap->trace_start = MALI_TRACE_BEGIN( &fPtr->trace );
+
+	MaliDRI2SwapProcess( pScrn, msc, ust );
 
-	FreeScratchGC(pGC);
+	return TRUE;
 }
 
+/* ust in us, as DRI2 hands it on to clients */
+static int MaliDRI2GetMSC( DrawablePtr pDraw, CARD64 *ust, CARD64 *msc )
+{
+	ScrnInfoPtr pScrn = xf86Screens[pDraw->pScreen->myNum];
+	MaliPtr fPtr = MALIPTR(pScrn);
+
+	maliVblankQuery( &fPtr->vblank, msc, ust );
+	*ust /= 1000;
+
+	return TRUE;
+}
+
+/* The client stays blocked until the target vblank has been seen */
+static int MaliDRI2ScheduleWaitMSC( ClientPtr client, DrawablePtr pDraw, CARD64 target_msc, CARD64 divisor, CARD64 remainder )
+{
+	ScrnInfoPtr pScrn = xf86Screens[pDraw->pScreen->myNum];
+	MaliPtr fPtr = MALIPTR(pScrn);
+	CARD64 msc, ust;
+
+	maliVblankQuery( &fPtr->vblank, &msc, &ust );
+	target_msc = MaliDRI2TargetMSC( msc, target_msc, divisor, remainder );
+	fPtr->dri2_msc_waits++;
+
+	if ( target_msc <= msc )
+	{
+		DRI2WaitMSCComplete( client, pDraw, msc, ust / 1000000000, (ust % 1000000000) / 1000 );
+		return TRUE;
+	}
+
+	if ( NULL == MaliDRI2QueueEvent( pScrn, client, pDraw, MALI_DRI2_WAIT_MSC, target_msc ) ) return FALSE;
+
+	DRI2BlockClient( client, pDraw );
+	maliVblankArm( &fPtr->vblank );
+
+	return TRUE;
+}
+#endif
+
 Bool MaliDRI2ScreenInit( ScreenPtr pScreen )
 {
 	ScrnInfoPtr pScrn = xf86Screens[pScreen->myNum];
@@ -309,6 +938,9 @@ Bool MaliDRI2ScreenInit( ScreenPtr pScreen )
 	}
 
 
+	fPtr->dri2_cached = 0;
+	fPtr->dri2_cache_timer = NULL;
+
 	info.driverName = "Mali DRI2";
 	info.deviceName = p;
 
@@ -320,15 +952,39 @@ Bool MaliDRI2ScreenInit( ScreenPtr pScreen )
 	info.version = 2;
 	info.CreateBuffer = MaliDRI2CreateBuffer;
 	info.DestroyBuffer = MaliDRI2DestroyBuffer;
-#else
+#elif DRI2INFOREC_VERSION == 3
 	info.version = 3;
 	info.CreateBuffer = MaliDRI2CreateBuffer;
 	info.DestroyBuffer = MaliDRI2DestroyBuffer;
+#else
+	info.version = 4;
+	info.CreateBuffer = MaliDRI2CreateBuffer;
+	info.DestroyBuffer = MaliDRI2DestroyBuffer;
+	info.ScheduleSwap = MaliDRI2ScheduleSwap;
+	info.GetMSC = MaliDRI2GetMSC;
+	info.ScheduleWaitMSC = MaliDRI2ScheduleWaitMSC;
+
+	fPtr->swaps = NULL;
+	if ( FALSE == maliVblankInit( &fPtr->vblank, pScrn->scrnIndex, fPtr->fb_lcd_fd, &fPtr->fb_lcd_var, MaliDRI2Vblank, pScrn ) ) return FALSE;
+
+	if ( FALSE == AddCallback( &ClientStateCallback, MaliDRI2ClientState, pScrn ) )
+	{
+		xf86DrvMsg( pScrn->scrnIndex, X_ERROR, "[%s:%d] failed to watch for clients leaving\n", __FUNCTION__, __LINE__ );
+		maliVblankFini( &fPtr->vblank );
+		return FALSE;
+	}
 #endif
 
 	info.CopyRegion = MaliDRI2CopyRegion;
 
-	if ( FALSE == DRI2ScreenInit( pScreen, &info ) ) return FALSE;
+	if ( FALSE == DRI2ScreenInit( pScreen, &info ) )
+	{
+#if DRI2INFOREC_VERSION >= 4
+		DeleteCallback( &ClientStateCallback, MaliDRI2ClientState, pScrn );
+		maliVblankFini( &fPtr->vblank );
+#endif
+		return FALSE;
+	}
 
 	return TRUE;
 }
@@ -340,5 +996,26 @@ void MaliDRI2CloseScreen( ScreenPtr pScreen )
 
 	DRI2CloseScreen( pScreen );
 
+	MaliDRI2FlushBufferCache( pScreen );
+	if ( NULL != fPtr->dri2_cache_timer )
+	{
+		TimerFree( fPtr->dri2_cache_timer );
+		fPtr->dri2_cache_timer = NULL;
+	}
+
+#if DRI2INFOREC_VERSION >= 4
+	/* the clients are gone, nobody is left to tell */
+	while ( NULL != fPtr->swaps )
+	{
+		MaliDRI2SwapPtr swap = fPtr->swaps;
+
+		fPtr->swaps = swap->next;
+		free( swap );
+	}
+
+	DeleteCallback( &ClientStateCallback, MaliDRI2ClientState, pScrn );
+	maliVblankFini( &fPtr->vblank );
+#endif
+
 	fPtr->dri_render = DRI_NONE;
 }
@@ -54,11 +54,342 @@ static struct mali_info mi;
 #define MALI_EXA_FUNC(s) exa->s = mali ## s
 #define IGNORE( a ) ( a = a );
 #define MALI_ALIGN( value, base ) (((value) + ((base) - 1)) & ~((base) - 1))
+#define MALI_CACHE_LINE 32 /* Cortex-A9 L1 and PL310 L2 */
 static Bool maliPrepareAccess(PixmapPtr pPix, int index);
 static void maliFinishAccess(PixmapPtr pPix, int index);
 
 static int fd_fbdev = -1;
 
+/* The pending jobs of a pixmap are all on one channel, see maliPickChannel */
+static MaliBltJob maliLaterJob(MaliBltJob a, MaliBltJob b)
+{
+	if (maliBltSchedJobDone(&mi.blt, a))
+		return b;
+	if (maliBltSchedJobDone(&mi.blt, b))
+		return a;
+
+	return MALI_BLT_JOB_AFTER(a, b) ? a : b;
+}
+
+/* Wait until the blitter is done with the pixmap, ignoring pending reads
+ * when the caller only reads it as well. */
+static void maliPixmapWait(PrivPixmap *privPixmap, Bool write)
+{
+	MaliBltJob job = privPixmap->write_job;
+
+	if (write)
+		job = maliLaterJob(job, privPixmap->read_job);
+
+	maliBltSchedWait(&mi.blt, job);
+}
+
+/*
+ * Channel and class for an operation on up to two pixmaps, made current
+ * for the submissions that follow. Blits still pending on either pixmap
+ * keep the operation on their channel, so that the pending jobs of a
+ * pixmap are always on a single channel. Everything done for a DRI2 swap
+ * counts as DRI2 work.
+ */
+static void maliPickChannel( PixmapPtr pA, PixmapPtr pB, MaliBltClass cls )
+{
+	PrivPixmap *privA = (PrivPixmap *)exaGetPixmapDriverPrivate(pA);
+	PrivPixmap *privB = pB ? (PrivPixmap *)exaGetPixmapDriverPrivate(pB) : NULL;
+	MaliBltJob deps[4];
+	int num_deps = 0;
+
+	if (privA)
+	{
+		deps[num_deps++] = privA->write_job;
+		deps[num_deps++] = privA->read_job;
+	}
+	if (privB)
+	{
+		deps[num_deps++] = privB->write_job;
+		deps[num_deps++] = privB->read_job;
+	}
+
+	mi.channel = maliBltSchedPick(&mi.blt, deps, num_deps);
+	mi.blt_class = mi.dri2_swap ? MALI_BLT_CLASS_DRI2 : cls;
+}
+
+#define MALI_BOX_EMPTY(b) ( (b)->x1 >= (b)->x2 || (b)->y1 >= (b)->y2 )
+
+static void maliBoxUnion( BoxPtr pBox, const BoxRec *pAdd )
+{
+	if ( MALI_BOX_EMPTY(pAdd) )
+		return;
+
+	if ( MALI_BOX_EMPTY(pBox) )
+	{
+		*pBox = *pAdd;
+		return;
+	}
+
+	pBox->x1 = min(pBox->x1, pAdd->x1);
+	pBox->y1 = min(pBox->y1, pAdd->y1);
+	pBox->x2 = max(pBox->x2, pAdd->x2);
+	pBox->y2 = max(pBox->y2, pAdd->y2);
+}
+
+static void maliBoxIntersect( BoxPtr pBox, const BoxRec *pClip )
+{
+	pBox->x1 = max(pBox->x1, pClip->x1);
+	pBox->y1 = max(pBox->y1, pClip->y1);
+	pBox->x2 = min(pBox->x2, pClip->x2);
+	pBox->y2 = min(pBox->y2, pClip->y2);
+}
+
+static void maliPixmapBox( PixmapPtr pPixmap, BoxPtr pBox )
+{
+	pBox->x1 = 0;
+	pBox->y1 = 0;
+	pBox->x2 = pPixmap->drawable.width;
+	pBox->y2 = pPixmap->drawable.height;
+}
+
+/*
+ * Grow pBox to the whole cache lines under it. Rectangles side by side
+ * share the lines at their edges, and unless the pitch is a multiple of
+ * the line size, so do the end of a scanline and the start of the next;
+ * those cases take whole scanlines and their neighbours.
+ */
+static void maliBoxToCacheLines( PixmapPtr pPixmap, BoxPtr pBox )
+{
+	int pitch = exaGetPixmapPitch(pPixmap);
+	int bpp = pPixmap->drawable.bitsPerPixel;
+	int start, end, rows;
+
+	if ( MALI_BOX_EMPTY(pBox) )
+		return;
+
+	start = pBox->x1 * bpp / 8;
+	end = (pBox->x2 * bpp + 7) / 8;
+	if ( pitch % MALI_CACHE_LINE )
+	{
+		/* scanlines start anywhere in a line */
+		start -= MALI_CACHE_LINE - 1;
+		end += MALI_CACHE_LINE - 1;
+	}
+	else
+	{
+		start &= ~(MALI_CACHE_LINE - 1);
+		end = MALI_ALIGN(end, MALI_CACHE_LINE);
+	}
+
+	if ( start >= 0 && end <= pitch )
+	{
+		pBox->x1 = start * 8 / bpp;
+		pBox->x2 = min((end * 8 + bpp - 1) / bpp, pPixmap->drawable.width);
+		return;
+	}
+
+	rows = (MALI_CACHE_LINE + pitch - 1) / pitch;
+	pBox->x1 = 0;
+	pBox->x2 = pPixmap->drawable.width;
+	pBox->y1 = max(pBox->y1 - rows, 0);
+	pBox->y2 = min(pBox->y2 + rows, pPixmap->drawable.height);
+}
+
+/*
+ * Clean or invalidate the cache lines under pBox only, one repetition of
+ * the hwmem region per scanline. Without a pixmap the whole buffer is
+ * synced.
+ */
+static void maliSetDomain( mali_mem_info *mem_info, unsigned long request, PixmapPtr pPixmap, BoxPtr pBox )
+{
+	struct hwmem_set_domain_request args;
+	CARD64 trace_start = MALI_TRACE_BEGIN(mi.trace);
+	args.id = mem_info->hwmem_alloc;
+	args.access = HWMEM_ACCESS_READ | HWMEM_ACCESS_WRITE | HWMEM_ACCESS_IMPORT;
+
+	/* using memset avoids API compatibility problems with fields added to the region. */
+	memset(&args.region, 0, sizeof(args.region));
+	if ( pPixmap )
+	{
+		unsigned int pitch = exaGetPixmapPitch(pPixmap);
+		unsigned int cpp = pPixmap->drawable.bitsPerPixel / 8;
+
+		args.region.offset = pBox->y1 * pitch;
+		if ( pBox->x1 == 0 && pBox->x2 == pPixmap->drawable.width )
+		{
+			/* full scanlines are one contiguous range */
+			args.region.count = 1;
+			args.region.end = (pBox->y2 - pBox->y1) * pitch;
+			args.region.size = args.region.end;
+		}
+		else
+		{
+			args.region.count = pBox->y2 - pBox->y1;
+			args.region.start = pBox->x1 * cpp;
+			args.region.end = pBox->x2 * cpp;
+			args.region.size = pitch;
+		}
+		mi.domain_sync_bytes += args.region.count * (args.region.end - args.region.start);
+	}
+	else
+	{
+		args.region.count = 1;
+		args.region.end = mem_info->usize;
+		args.region.size = mem_info->usize;
+		mi.domain_sync_bytes += mem_info->usize;
+	}
+	maliHwmemDevIoctl(mi.pool.fd, request, (unsigned long)&args);
+
+	mi.domain_syncs++;
+
+	MALI_TRACE_END(mi.trace, MALI_TRACE_DOMAIN_SYNC, trace_start,
+		       args.region.count * (args.region.end - args.region.start), request == HWMEM_SET_CPU_DOMAIN_IOC);
+}
+
+/* Sync the first length bytes of a buffer */
+static void maliSetDomainRange( mali_mem_info *mem_info, unsigned long request, unsigned long length )
+{
+	struct hwmem_set_domain_request args;
+	CARD64 trace_start = MALI_TRACE_BEGIN(mi.trace);
+	args.id = mem_info->hwmem_alloc;
+	args.access = HWMEM_ACCESS_READ | HWMEM_ACCESS_WRITE | HWMEM_ACCESS_IMPORT;
+
+	memset(&args.region, 0, sizeof(args.region));
+	args.region.count = 1;
+	args.region.end = length;
+	args.region.size = length;
+	maliHwmemDevIoctl(mi.pool.fd, request, (unsigned long)&args);
+
+	mi.domain_syncs++;
+	mi.domain_sync_bytes += length;
+
+	MALI_TRACE_END(mi.trace, MALI_TRACE_DOMAIN_SYNC, trace_start, length, request == HWMEM_SET_CPU_DOMAIN_IOC);
+}
+
+/*
+ * Cache maintenance only happens on real transitions and only over the
+ * area involved. cpu_dirty bounds what the CPU may have written since the
+ * last clean, which the blitter must not read or overwrite before it is
+ * cleaned. device_dirty bounds what the blitter wrote since the CPU last
+ * invalidated. Everything else is left alone, which is why the blits carry
+ * the NO_CACHE_FLUSH flags. Exported buffers can be written by other
+ * devices behind our back, so CPU access always syncs those.
+ */
+static void maliPixmapToDevice( PixmapPtr pPixmap )
+{
+	PrivPixmap *privPixmap = (PrivPixmap *)exaGetPixmapDriverPrivate(pPixmap);
+
+	if ( MALI_BOX_EMPTY(&privPixmap->cpu_dirty) )
+	{
+		mi.domain_syncs_skipped++;
+		return;
+	}
+
+	maliBoxToCacheLines(pPixmap, &privPixmap->cpu_dirty);
+	maliSetDomain(privPixmap->mem_info, HWMEM_SET_SYNC_DOMAIN_IOC, pPixmap, &privPixmap->cpu_dirty);
+	privPixmap->cpu_dirty.x2 = privPixmap->cpu_dirty.x1;
+}
+
+/* Record a blit writing pBox of the pixmap */
+static void maliPixmapDeviceWrite( PrivPixmap *privPixmap, MaliBltJob job, const BoxRec *pBox )
+{
+	if ( !job )
+		return;
+
+	privPixmap->write_job = job;
+	maliBoxUnion(&privPixmap->device_dirty, pBox);
+}
+
+/* pAccess limits the area the CPU is about to touch, NULL for all of it */
+static void maliPixmapToCpu( PixmapPtr pPixmap, Bool write, BoxPtr pAccess )
+{
+	PrivPixmap *privPixmap = (PrivPixmap *)exaGetPixmapDriverPrivate(pPixmap);
+	BoxRec box;
+
+	maliPixmapBox(pPixmap, &box);
+	if ( pAccess )
+		maliBoxIntersect(&box, pAccess);
+
+	if ( privPixmap->exported )
+	{
+		maliSetDomain(privPixmap->mem_info, HWMEM_SET_CPU_DOMAIN_IOC, pPixmap, &box);
+	}
+	else if ( !MALI_BOX_EMPTY(&privPixmap->device_dirty) )
+	{
+		BoxRec sync = box;
+		BoxRec dirty = privPixmap->device_dirty;
+
+		/* lines the access shares with the blit's output must go too */
+		maliBoxToCacheLines(pPixmap, &sync);
+		maliBoxToCacheLines(pPixmap, &dirty);
+		maliBoxIntersect(&sync, &dirty);
+		if ( !MALI_BOX_EMPTY(&sync) )
+			maliSetDomain(privPixmap->mem_info, HWMEM_SET_CPU_DOMAIN_IOC, pPixmap, &sync);
+		else
+			mi.domain_syncs_skipped++;
+
+		/* anything outside the access box stays stale for the CPU */
+		if ( sync.x1 == dirty.x1 && sync.y1 == dirty.y1 && sync.x2 == dirty.x2 && sync.y2 == dirty.y2 )
+			privPixmap->device_dirty.x2 = privPixmap->device_dirty.x1;
+	}
+	else
+		mi.domain_syncs_skipped++;
+
+	if ( write )
+		maliBoxUnion(&privPixmap->cpu_dirty, &box);
+}
+
+/* Limit the next PrepareAccess of the pixmap to the given rectangle */
+static void maliSetAccessRegion( PixmapPtr pPixmap, int x, int y, int width, int height )
+{
+	PrivPixmap *privPixmap = (PrivPixmap *)exaGetPixmapDriverPrivate(pPixmap);
+
+	privPixmap->access.x1 = x;
+	privPixmap->access.y1 = y;
+	privPixmap->access.x2 = x + width;
+	privPixmap->access.y2 = y + height;
+}
+
+/*
+ * Give a pixmap buffer back to the pool once the blitter is done with it.
+ * Exported buffers are released instead, clients may still have them.
+ */
+static void maliPixmapReleaseHwmem( PrivPixmap *privPixmap )
+{
+	maliPixmapWait(privPixmap, TRUE);
+
+	if ( privPixmap->exported )
+	{
+		maliHwmemPoolRelease( &mi.pool, privPixmap->mem_info );
+		privPixmap->exported = FALSE;
+	}
+	else
+	{
+		/* dirty lines evicted later would corrupt the next user's blits */
+		if ( !MALI_BOX_EMPTY(&privPixmap->cpu_dirty) )
+			maliSetDomain(privPixmap->mem_info, HWMEM_SET_SYNC_DOMAIN_IOC, NULL, NULL);
+
+		maliHwmemPoolFree( &mi.pool, privPixmap->mem_info );
+	}
+	privPixmap->mem_info = NULL;
+	privPixmap->addr = NULL;
+	memset(&privPixmap->cpu_dirty, 0, sizeof(BoxRec));
+	memset(&privPixmap->device_dirty, 0, sizeof(BoxRec));
+}
+
+/*
+ * Pixmaps the blitter never sees live in malloc'ed memory: everything of 8
+ * bpp or less, which no hook accelerates, and anything up to sysmem_area
+ * pixels, where setting up a blit costs more than the CPU doing the work.
+ */
+static Bool maliPixmapUseSysmem( PixmapPtr pPixmap )
+{
+	return pPixmap->drawable.bitsPerPixel <= 8 ||
+	       pPixmap->drawable.width * pPixmap->drawable.height <= mi.sysmem_area;
+}
+
+static Bool maliPixmapInSysmem( PixmapPtr pPixmap )
+{
+	PrivPixmap *privPixmap = (PrivPixmap *)exaGetPixmapDriverPrivate(pPixmap);
+
+	return privPixmap && privPixmap->in_sysmem;
+}
+
 static int maliGetColorFormat(int bitsPerPixel)
 {
         switch(bitsPerPixel) {
@@ -76,6 +407,55 @@ static int maliGetColorFormat(int bitsPerPixel)
         }
 }
 
+static int maliGetBpp(int fmt)
+{
+        switch(fmt) {
+                case BLT_FMT_16_BIT_ARGB1555:
+                case BLT_FMT_16_BIT_RGB565:
+                        return 16;
+                case BLT_FMT_24_BIT_RGB888:
+                        return 24;
+                default:
+                        return 32;
+        }
+}
+
+/* pixman works on the pixmap directly, without waiting or syncing caches */
+static Bool maliPixmapCpuReady( PixmapPtr pPixmap, Bool write )
+{
+	PrivPixmap *privPixmap = (PrivPixmap *)exaGetPixmapDriverPrivate(pPixmap);
+	int bpp = pPixmap->drawable.bitsPerPixel;
+
+	return (bpp == 16 || bpp == 32) && !privPixmap->isFrameBuffer && !privPixmap->exported &&
+	       maliBltSchedJobDone(&mi.blt, privPixmap->write_job) &&
+	       (!write || maliBltSchedJobDone(&mi.blt, privPixmap->read_job));
+}
+
+/*
+ * Whether the CPU does a width x height operation on pDst, reading pSrc
+ * unless NULL, rather than the blitter. Only idle pixmaps in cached
+ * memory qualify, where the CPU neither waits for the blitter nor syncs
+ * caches first. The blitter is charged for the blits queued on the
+ * channel ahead of the new one.
+ */
+static Bool maliDispatchCpu( MaliCostKernel kernel, PixmapPtr pDst, PixmapPtr pSrc, int width, int height )
+{
+	const MaliCostModel *model = &mi.cost.model[kernel];
+	int bytes = width * height * (pDst->drawable.bitsPerPixel / 8);
+	Bool cpu;
+
+	cpu = mi.dispatch && maliPixmapCpuReady(pDst, TRUE) &&
+	      (!pSrc || (maliPixmapCpuReady(pSrc, FALSE) && pSrc->drawable.bitsPerPixel == pDst->drawable.bitsPerPixel)) &&
+	      maliCostCpu(model, height, bytes) < maliCostHw(model, height, bytes) + (CARD64)maliBltPending(mi.channel) * model->hw_op_ns;
+
+	if (cpu)
+		mi.dispatch_cpu[kernel]++;
+	else
+		mi.dispatch_hw[kernel]++;
+
+	return cpu;
+}
+
 static Bool maliPrepareSolid( PixmapPtr pPixmap, int alu, Pixel planemask, Pixel fg )
 {
 	int ret = 0;
@@ -84,10 +464,18 @@ static Bool maliPrepareSolid( PixmapPtr pPixmap, int alu, Pixel planemask, Pixel
 	IGNORE( alu );
 	IGNORE( planemask );
 
-	if (pPixmap->drawable.bitsPerPixel <= 8)
+	if (pPixmap->drawable.bitsPerPixel <= 8) {
+		mi.fallbacks[MALI_FALLBACK_SOLID_DEPTH]++;
+		ret = FALSE;
+	} else if (maliPixmapInSysmem(pPixmap)) {
+		mi.fallbacks[MALI_FALLBACK_SOLID_SYSMEM]++;
 		ret = FALSE;
-	else {
+	} else {
 	        mi.fillColor = fg;
+		mi.pSolidPixmap = pPixmap;
+		maliPixmapToDevice(pPixmap);
+		maliPickChannel(pPixmap, NULL, MALI_BLT_CLASS_FILL);
+		mi.num_solid_boxes = 0;
 		ret = TRUE;
 	}
 
@@ -96,18 +484,74 @@ static Bool maliPrepareSolid( PixmapPtr pPixmap, int alu, Pixel planemask, Pixel
  	return ret;
 }
 
-static void maliSolid( PixmapPtr pPixmap, int x1, int y1, int x2, int y2 )
+/* Fill the queued rectangles the CPU does faster, leaving the rest queued */
+static void maliSolidCpu( PixmapPtr pPixmap )
+{
+	BoxRec cpu_boxes[MALI_SOLID_BATCH_SIZE];
+	BoxRec access = { 0, 0, 0, 0 };
+	int bpp = pPixmap->drawable.bitsPerPixel;
+	int num_cpu = 0, num_hw = 0, rows = 0, bytes = 0;
+	CARD64 start;
+	int i;
+
+	for (i = 0; i < mi.num_solid_boxes; i++) {
+		BoxPtr pBox = &mi.solid_boxes[i];
+
+		if (maliDispatchCpu(MALI_COST_FILL, pPixmap, NULL, pBox->x2 - pBox->x1, pBox->y2 - pBox->y1)) {
+			cpu_boxes[num_cpu++] = *pBox;
+			maliBoxUnion(&access, pBox);
+		} else
+			mi.solid_boxes[num_hw++] = *pBox;
+	}
+
+	if (num_cpu == 0)
+		return;
+
+	start = maliTraceNow();
+	maliSetAccessRegion(pPixmap, access.x1, access.y1, access.x2 - access.x1, access.y2 - access.y1);
+	if (!maliPrepareAccess(pPixmap, EXA_PREPARE_DEST)) {
+		/* the blitter takes them after all */
+		memcpy(&mi.solid_boxes[num_hw], cpu_boxes, num_cpu * sizeof(BoxRec));
+		return;
+	}
+
+	for (i = 0; i < num_cpu; i++) {
+		BoxPtr pBox = &cpu_boxes[i];
+
+		pixman_fill((uint32_t *)pPixmap->devPrivate.ptr, exaGetPixmapPitch(pPixmap) / 4, bpp,
+			    pBox->x1, pBox->y1, pBox->x2 - pBox->x1, pBox->y2 - pBox->y1, mi.fillColor);
+		rows += pBox->y2 - pBox->y1;
+		bytes += (pBox->x2 - pBox->x1) * (pBox->y2 - pBox->y1) * (bpp / 8);
+	}
+
+	maliFinishAccess(pPixmap, EXA_PREPARE_DEST);
+	mi.num_solid_boxes = num_hw;
+
+	/* the remaining rectangles are blitted right away */
+	if (num_hw > 0)
+		maliPixmapToDevice(pPixmap);
+
+	maliCostCpuMeasured(&mi.cost.model[MALI_COST_FILL], num_cpu, rows, bytes, maliTraceNow() - start);
+}
+
+/* Submit all queued solid rectangles back to back */
+static void maliSolidFlush( void )
 {
 	struct blt_req bltreq = {0};
-	int status = 0;
-	MaliPtr fPtr;
-	PrivPixmap *privPixmap = (PrivPixmap *)exaGetPixmapDriverPrivate(pPixmap);
-	fPtr = MALIPTR(xf86Screens[pPixmap->drawable.pScreen->myNum]);
+	PixmapPtr pPixmap = mi.pSolidPixmap;
+	PrivPixmap *privPixmap;
+	MaliBltJob job;
+	int i;
 
-	TRACE_ENTER();
+	maliSolidCpu(pPixmap);
+
+	if (mi.num_solid_boxes == 0)
+		return;
+
+	privPixmap = (PrivPixmap *)exaGetPixmapDriverPrivate(pPixmap);
 
 	bltreq.size = sizeof(struct blt_req);
-	bltreq.flags = BLT_FLAG_ASYNCH | BLT_FLAG_SOURCE_FILL_RAW;
+	bltreq.flags = MALI_BLT_FLAGS | BLT_FLAG_SOURCE_FILL_RAW;
 	bltreq.transform = BLT_TRANSFORM_NONE;
 	bltreq.src_color = mi.fillColor;
 	bltreq.dst_img.buf.type = BLT_PTR_HWMEM_BUF_NAME_OFFSET;
@@ -116,20 +560,60 @@ static void maliSolid( PixmapPtr pPixmap, int x1, int y1, int x2, int y2 )
 	bltreq.dst_img.height = pPixmap->drawable.height;
 	bltreq.dst_img.fmt = maliGetColorFormat(pPixmap->drawable.bitsPerPixel);
 	bltreq.dst_img.pitch = exaGetPixmapPitch(pPixmap);
-	bltreq.dst_rect.x = x1;
-	bltreq.dst_rect.y = y1;
-	bltreq.dst_rect.width = x2 - x1;
-	bltreq.dst_rect.height = y2 - y1;
-	bltreq.dst_clip_rect.x = x1;
-	bltreq.dst_clip_rect.y = y1;
-	bltreq.dst_clip_rect.width = x2 - x1;
-	bltreq.dst_clip_rect.height = y2 - y1;
-
-	do {
-		status = blt_request(mi.blt_handle, &bltreq);
-		if (status < 0)
-			xf86DrvMsg(mi.pScrn->scrnIndex, X_INFO, "maliSolid blt_request failed, errno %d\n", errno);
-	} while (status < 0 && errno == EAGAIN);
+
+	for (i = 0; i < mi.num_solid_boxes; i++) {
+		BoxPtr pBox = &mi.solid_boxes[i];
+
+		bltreq.dst_rect.x = pBox->x1;
+		bltreq.dst_rect.y = pBox->y1;
+		bltreq.dst_rect.width = pBox->x2 - pBox->x1;
+		bltreq.dst_rect.height = pBox->y2 - pBox->y1;
+		bltreq.dst_clip_rect = bltreq.dst_rect;
+
+		job = maliBltSubmit(mi.channel, &bltreq, mi.blt_class);
+		maliPixmapDeviceWrite(privPixmap, job, pBox);
+	}
+
+	mi.solid_requests += mi.num_solid_boxes;
+	mi.solid_flushes++;
+	mi.num_solid_boxes = 0;
+}
+
+static void maliSolid( PixmapPtr pPixmap, int x1, int y1, int x2, int y2 )
+{
+	BoxPtr pLast;
+
+	TRACE_ENTER();
+	IGNORE( pPixmap );
+
+	mi.solid_rects++;
+
+	/* Rectangles continuing the previous one along a full edge are merged
+	 * into it, which folds the per-scanline spans of filled regions. */
+	if (mi.num_solid_boxes > 0) {
+		pLast = &mi.solid_boxes[mi.num_solid_boxes - 1];
+
+		if (pLast->x1 == x1 && pLast->x2 == x2 && pLast->y2 == y1) {
+			pLast->y2 = y2;
+			TRACE_EXIT();
+			return;
+		}
+
+		if (pLast->y1 == y1 && pLast->y2 == y2 && pLast->x2 == x1) {
+			pLast->x2 = x2;
+			TRACE_EXIT();
+			return;
+		}
+	}
+
+	if (mi.num_solid_boxes == MALI_SOLID_BATCH_SIZE)
+		maliSolidFlush();
+
+	pLast = &mi.solid_boxes[mi.num_solid_boxes++];
+	pLast->x1 = x1;
+	pLast->y1 = y1;
+	pLast->x2 = x2;
+	pLast->y2 = y2;
 
 	TRACE_EXIT();
 }
@@ -138,8 +622,10 @@ static void maliDoneSolid( PixmapPtr pPixmap )
 {
 	TRACE_ENTER();
 
+	maliSolidFlush();
+
 	mi.fillColor = 0;	
-	(void)blt_synch(mi.blt_handle, 0);
+	mi.pSolidPixmap = NULL;
 
 	IGNORE( pPixmap );
 
@@ -152,15 +638,22 @@ static Bool maliPrepareCopy( PixmapPtr pSrcPixmap, PixmapPtr pDstPixmap, int xdi
 	
 	TRACE_ENTER();
 
-        if (pSrcPixmap->drawable.bitsPerPixel <= 8 || pDstPixmap->drawable.bitsPerPixel <= 8)
+        if (pSrcPixmap->drawable.bitsPerPixel <= 8 || pDstPixmap->drawable.bitsPerPixel <= 8) {
+                mi.fallbacks[MALI_FALLBACK_COPY_DEPTH]++;
+                ret = FALSE;
+        } else if (maliPixmapInSysmem(pSrcPixmap) || maliPixmapInSysmem(pDstPixmap)) {
+                mi.fallbacks[MALI_FALLBACK_COPY_SYSMEM]++;
                 ret = FALSE;
-        else {
+        } else {
                 mi.pSourcePixmap = pSrcPixmap;
+                mi.copy_xdir = xdir;
+                mi.copy_ydir = ydir;
+                maliPixmapToDevice(pSrcPixmap);
+                maliPixmapToDevice(pDstPixmap);
+                maliPickChannel(pSrcPixmap, pDstPixmap, MALI_BLT_CLASS_COPY);
                 ret = TRUE;
         }
 
-	IGNORE( xdir );
-	IGNORE( ydir );
 	IGNORE( alu );
 	IGNORE( planemask );
 	TRACE_EXIT();
@@ -168,105 +661,592 @@ static Bool maliPrepareCopy( PixmapPtr pSrcPixmap, PixmapPtr pDstPixmap, int xdi
 	return ret;
 }
 
+static void maliSetupPixmapImg( struct blt_img *img, PixmapPtr pPixmap )
+{
+	PrivPixmap *privPixmap = (PrivPixmap *)exaGetPixmapDriverPrivate(pPixmap);
+
+	memset(img, 0, sizeof(*img));
+	img->fmt = maliGetColorFormat(pPixmap->drawable.bitsPerPixel);
+	img->buf.type = BLT_PTR_HWMEM_BUF_NAME_OFFSET;
+	img->buf.hwmem_buf_name = privPixmap->mem_info->hwmem_global_name;
+	img->width = pPixmap->drawable.width;
+	img->height = pPixmap->drawable.height;
+	img->pitch = exaGetPixmapPitch(pPixmap);
+}
+
+static MaliBltJob maliCopyRect( struct blt_img *src, struct blt_img *dst, int srcX, int srcY, int dstX, int dstY, int width, int height )
+{
+	struct blt_req bltreq = {0};
+
+	bltreq.size = sizeof(struct blt_req);
+	bltreq.flags = MALI_BLT_FLAGS;
+	bltreq.transform = BLT_TRANSFORM_NONE;
+	bltreq.src_img = *src;
+	bltreq.dst_img = *dst;
+	bltreq.src_rect.x = srcX;
+	bltreq.src_rect.y = srcY;
+	bltreq.src_rect.width = width;
+	bltreq.src_rect.height = height;
+	bltreq.dst_rect.x = dstX;
+	bltreq.dst_rect.y = dstY;
+	bltreq.dst_rect.width = width;
+	bltreq.dst_rect.height = height;
+	bltreq.dst_clip_rect = bltreq.dst_rect;
+
+	return maliBltSubmit(mi.channel, &bltreq, mi.blt_class);
+}
+
+static void maliScratchFree( void )
+{
+	if (!mi.scratch)
+		return;
+
+	maliBltSchedWait(&mi.blt, mi.scratch_job);
+	maliHwmemRelease(mi.pool.fd, mi.scratch);
+	mi.scratch = NULL;
+	mi.scratch_job = 0;
+}
+
+/* Blitter-only bounce buffer for overlapping copies, grown on demand */
+static mali_mem_info *maliScratchGet( unsigned long size )
+{
+	if (mi.scratch && mi.scratch->usize >= size)
+		return mi.scratch;
+
+	maliScratchFree();
+
+	mi.scratch = maliHwmemAlloc(mi.pool.fd, size, HWMEM_ALLOC_HINT_UNCACHED);
+
+	return mi.scratch;
+}
+
+/*
+ * Copy between overlapping rectangles of one pixmap on the blitter.
+ *
+ * The rectangle is cut into bands no thicker than the distance moved, so
+ * that source and destination of a band never overlap, and the bands are
+ * issued in the order given by xdir/ydir so that no band reads pixels an
+ * earlier band has already overwritten. Small moves would need too many
+ * bands; those bounce through the scratch buffer instead. Both rely on
+ * the blitter executing the requests of a handle in order.
+ */
+static Bool maliCopyOverlap( struct blt_img *img, int srcX, int srcY, int dstX, int dstY, int width, int height, MaliBltJob *job )
+{
+	int dx = abs(dstX - srcX);
+	int dy = abs(dstY - srcY);
+	int off, len;
+
+	if (dy > 0 && (height + dy - 1) / dy <= MALI_COPY_MAX_BANDS)
+	{
+		for (off = 0; off < height; off += len)
+		{
+			len = min(dy, height - off);
+			if (mi.copy_ydir < 0)
+				*job = maliCopyRect(img, img, srcX, srcY + height - off - len, dstX, dstY + height - off - len, width, len);
+			else
+				*job = maliCopyRect(img, img, srcX, srcY + off, dstX, dstY + off, width, len);
+		}
+		mi.copy_bands++;
+		return TRUE;
+	}
+
+	if (dy == 0 && dx > 0 && (width + dx - 1) / dx <= MALI_COPY_MAX_BANDS)
+	{
+		for (off = 0; off < width; off += len)
+		{
+			len = min(dx, width - off);
+			if (mi.copy_xdir < 0)
+				*job = maliCopyRect(img, img, srcX + width - off - len, srcY, dstX + width - off - len, dstY, len, height);
+			else
+				*job = maliCopyRect(img, img, srcX + off, srcY, dstX + off, dstY, len, height);
+		}
+		mi.copy_bands++;
+		return TRUE;
+	}
+
+	{
+		struct blt_img tmp = *img;
+		int pitch = MALI_ALIGN((width * maliGetBpp(img->fmt) + 7) / 8, 8);
+		mali_mem_info *scratch = maliScratchGet((unsigned long)pitch * height);
+
+		if (!scratch)
+			return FALSE;
+
+		/* the previous bounce may have gone to another channel */
+		maliBltSchedOrder(&mi.blt, mi.channel, mi.scratch_job);
+
+		tmp.buf.hwmem_buf_name = scratch->hwmem_global_name;
+		tmp.width = width;
+		tmp.height = height;
+		tmp.pitch = pitch;
+
+		(void)maliCopyRect(img, &tmp, srcX, srcY, 0, 0, width, height);
+		*job = maliCopyRect(&tmp, img, 0, 0, dstX, dstY, width, height);
+		mi.scratch_job = *job;
+		mi.copy_bounces++;
+	}
+
+	return TRUE;
+}
+
+/* Copy between disjoint rectangles with pixman, FALSE if it could not */
+static Bool maliCopyCpu( PixmapPtr pDstPixmap, int srcX, int srcY, int dstX, int dstY, int width, int height )
+{
+	PixmapPtr pSrcPixmap = mi.pSourcePixmap;
+	int bpp = pDstPixmap->drawable.bitsPerPixel;
+	CARD64 start = maliTraceNow();
+	Bool ret;
+
+	if (pSrcPixmap == pDstPixmap) {
+		BoxRec access = { srcX, srcY, srcX + width, srcY + height };
+		BoxRec dst = { dstX, dstY, dstX + width, dstY + height };
+
+		maliBoxUnion(&access, &dst);
+		maliSetAccessRegion(pDstPixmap, access.x1, access.y1, access.x2 - access.x1, access.y2 - access.y1);
+	} else {
+		maliSetAccessRegion(pSrcPixmap, srcX, srcY, width, height);
+		maliSetAccessRegion(pDstPixmap, dstX, dstY, width, height);
+		if (!maliPrepareAccess(pSrcPixmap, EXA_PREPARE_SRC))
+			return FALSE;
+	}
+
+	if (!maliPrepareAccess(pDstPixmap, EXA_PREPARE_DEST)) {
+		if (pSrcPixmap != pDstPixmap)
+			maliFinishAccess(pSrcPixmap, EXA_PREPARE_SRC);
+		return FALSE;
+	}
+
+	ret = pixman_blt((uint32_t *)pSrcPixmap->devPrivate.ptr, (uint32_t *)pDstPixmap->devPrivate.ptr,
+			 exaGetPixmapPitch(pSrcPixmap) / 4, exaGetPixmapPitch(pDstPixmap) / 4, bpp, bpp,
+			 srcX, srcY, dstX, dstY, width, height);
+
+	maliFinishAccess(pDstPixmap, EXA_PREPARE_DEST);
+	if (pSrcPixmap != pDstPixmap)
+		maliFinishAccess(pSrcPixmap, EXA_PREPARE_SRC);
+
+	if (ret)
+		maliCostCpuMeasured(&mi.cost.model[MALI_COST_COPY], 1, height, width * height * (bpp / 8), maliTraceNow() - start);
+
+	return ret;
+}
+
 static void maliCopy( PixmapPtr pDstPixmap, int srcX, int srcY, int dstX, int dstY, int width, int height )
 {
         PrivPixmap *privPixmapSrc;
         PrivPixmap *privPixmapDst;
-        MaliPtr fPtr;
+        struct blt_img src_img, dst_img;
+        MaliBltJob job = 0;
 
         TRACE_ENTER();
 
+        /* copying a rectangle of a pixmap onto itself changes nothing */
+        if (mi.pSourcePixmap == pDstPixmap && srcX == dstX && srcY == dstY) {
+                TRACE_EXIT();
+                return;
+        }
+
         privPixmapSrc = (PrivPixmap *)exaGetPixmapDriverPrivate(mi.pSourcePixmap);
         privPixmapDst = (PrivPixmap *)exaGetPixmapDriverPrivate(pDstPixmap);
-        fPtr = MALIPTR(xf86Screens[pDstPixmap->drawable.pScreen->myNum]);
 
-        if ((mi.pSourcePixmap == pDstPixmap) && 
-		!(((srcY + height < dstY) || (dstY + height < srcY)) &&
-		  ((srcX + width < dstX) || (dstX + width < srcX)))) {
-                /* SW blitting if areas are overlapping on the same surface */
-                RegionPtr pReg;
-
-                if (!mi.pGC) {
-                        mi.pGC = GetScratchGC(pDstPixmap->drawable.depth, pDstPixmap->drawable.pScreen);
-                        ValidateGC(&pDstPixmap->drawable, mi.pGC);
+        maliSetupPixmapImg(&src_img, mi.pSourcePixmap);
+        maliSetupPixmapImg(&dst_img, pDstPixmap);
+
+        if ((mi.pSourcePixmap == pDstPixmap) &&
+		abs(dstX - srcX) < width && abs(dstY - srcY) < height) {
+                if (!maliCopyOverlap(&dst_img, srcX, srcY, dstX, dstY, width, height, &job)) {
+                        /* SW blitting as a last resort */
+                        BoxRec access = { srcX, srcY, srcX + width, srcY + height };
+                        BoxRec dst = { dstX, dstY, dstX + width, dstY + height };
+                        RegionPtr pReg;
+
+                        mi.fallbacks[MALI_FALLBACK_COPY_OVERLAP]++;
+
+                        if (!mi.pGC) {
+                                mi.pGC = GetScratchGC(pDstPixmap->drawable.depth, pDstPixmap->drawable.pScreen);
+                                ValidateGC(&pDstPixmap->drawable, mi.pGC);
+                        }
+
+                        /* source and destination are one pixmap, access both at once */
+                        maliBoxUnion(&access, &dst);
+                        maliSetAccessRegion(pDstPixmap, access.x1, access.y1, access.x2 - access.x1, access.y2 - access.y1);
+                        maliPrepareAccess(pDstPixmap, EXA_PREPARE_DEST);
+                        pReg = fbCopyArea(&mi.pSourcePixmap->drawable, &pDstPixmap->drawable,
+                                          mi.pGC, srcX, srcY, width, height, dstX, dstY);
+                        if (pReg) {
+                                REGION_DESTROY(pDstPixmap->drawable.pScreen, pReg);
+                        }
+
+                        maliFinishAccess(pDstPixmap, EXA_PREPARE_DEST);
+
+                        /* later blits of this copy read what the CPU wrote */
+                        maliPixmapToDevice(pDstPixmap);
                 }
+        } else if (maliDispatchCpu(MALI_COST_COPY, pDstPixmap, mi.pSourcePixmap, width, height) &&
+                   maliCopyCpu(pDstPixmap, srcX, srcY, dstX, dstY, width, height)) {
+                /* SW blitting, cheaper than a blit of this size */
+        } else {
+                /* HW blitting, after the CPU copies of this operation */
+                if (!MALI_BOX_EMPTY(&privPixmapDst->cpu_dirty))
+                        maliPixmapToDevice(pDstPixmap);
+                job = maliCopyRect(&src_img, &dst_img, srcX, srcY, dstX, dstY, width, height);
+        }
 
-                maliPrepareAccess(mi.pSourcePixmap, EXA_PREPARE_SRC);
-                maliPrepareAccess(pDstPixmap, EXA_PREPARE_DEST);
-                pReg = fbCopyArea(&mi.pSourcePixmap->drawable, &pDstPixmap->drawable,
-                                  mi.pGC, srcX, srcY, width, height, dstX, dstY);
-                if (pReg) {
-			REGION_DESTROY(pDstPixmap->drawable.pScreen, pReg);
-                }
+        if (job) {
+                BoxRec box = { dstX, dstY, dstX + width, dstY + height };
 
-                maliFinishAccess(mi.pSourcePixmap, EXA_PREPARE_SRC);
-                maliFinishAccess(pDstPixmap, EXA_PREPARE_DEST);
+                mi.copies++;
 
-        } else {
-                /* HW blitting */
-                struct blt_req bltreq = {0};
-                int status = 0;
-
-                bltreq.size = sizeof(struct blt_req);
-                bltreq.flags = BLT_FLAG_ASYNCH;
-                bltreq.transform = BLT_TRANSFORM_NONE;
-                bltreq.src_img.fmt = maliGetColorFormat(mi.pSourcePixmap->drawable.bitsPerPixel);
-                bltreq.src_img.buf.type = BLT_PTR_HWMEM_BUF_NAME_OFFSET;
-                bltreq.src_img.buf.hwmem_buf_name = privPixmapSrc->mem_info->hwmem_global_name;
-                bltreq.src_img.width = mi.pSourcePixmap->drawable.width;
-                bltreq.src_img.height = mi.pSourcePixmap->drawable.height;
-                bltreq.src_img.pitch = exaGetPixmapPitch(mi.pSourcePixmap);
-                bltreq.dst_img.fmt = maliGetColorFormat(pDstPixmap->drawable.bitsPerPixel);
-                bltreq.dst_img.buf.type = BLT_PTR_HWMEM_BUF_NAME_OFFSET;
-                bltreq.dst_img.buf.hwmem_buf_name = privPixmapDst->mem_info->hwmem_global_name;
-                bltreq.dst_img.width = pDstPixmap->drawable.width;
-                bltreq.dst_img.height = pDstPixmap->drawable.height;
-                bltreq.dst_img.pitch = exaGetPixmapPitch(pDstPixmap);
-                bltreq.src_rect.x = srcX;
-                bltreq.src_rect.y = srcY;
-                bltreq.src_rect.width = width;
-                bltreq.src_rect.height = height;
-                bltreq.dst_rect.x = dstX;
-                bltreq.dst_rect.y = dstY;
-                bltreq.dst_rect.width = width;
-                bltreq.dst_rect.height = height;
-                bltreq.dst_clip_rect.x = dstX;
-                bltreq.dst_clip_rect.y = dstY;
-                bltreq.dst_clip_rect.width = width;
-                bltreq.dst_clip_rect.height = height;
-
-                do {
-                        status = blt_request(mi.blt_handle, &bltreq);
-                        if (status < 0)
-                                xf86DrvMsg(mi.pScrn->scrnIndex, X_INFO, "maliCopy blt_request failed, errno %d\n", errno);
-                } while (status < 0 && errno == EAGAIN);
+                privPixmapSrc->read_job = job;
+                maliPixmapDeviceWrite(privPixmapDst, job, &box);
+        }
+
+	TRACE_EXIT();
+}
 
+static void maliDoneCopy( PixmapPtr pDstPixmap )
+{
+	TRACE_ENTER();
+
+        if (mi.pGC) {
+                FreeScratchGC(mi.pGC);
+                mi.pGC = NULL;
         }
 
+	IGNORE( pDstPixmap );
+	TRACE_EXIT();
+}
+
+/*
+ * Copy boxes between two hwmem pixmaps, for DRI2 swaps. Boxes are in
+ * destination coordinates, the source is offset by dx, dy. The boxes of a
+ * region are disjoint, so they go to the blitter back to back on one
+ * channel without waiting in between. Returns the pixels copied, -1 when
+ * the blitter cannot do the copy.
+ */
+int maliExaCopyBoxes( PixmapPtr pSrcPixmap, PixmapPtr pDstPixmap, const BoxRec *pBoxes, int nbox, int dx, int dy )
+{
+	PrivPixmap *privSrc = (PrivPixmap *)exaGetPixmapDriverPrivate(pSrcPixmap);
+	PrivPixmap *privDst = (PrivPixmap *)exaGetPixmapDriverPrivate(pDstPixmap);
+	struct blt_img src_img, dst_img;
+	BoxRec dst_bounds, src_bounds, extents = { 0, 0, 0, 0 };
+	MaliBltJob job = 0;
+	int pixels = 0;
+	int i;
+
+	if (!privSrc || !privDst || !privSrc->mem_info || !privDst->mem_info || pSrcPixmap == pDstPixmap ||
+	    pSrcPixmap->drawable.bitsPerPixel != pDstPixmap->drawable.bitsPerPixel ||
+	    pDstPixmap->drawable.bitsPerPixel <= 8)
+		return -1;
+
+	maliPixmapToDevice(pSrcPixmap);
+	maliPixmapToDevice(pDstPixmap);
+	maliPickChannel(pSrcPixmap, pDstPixmap, MALI_BLT_CLASS_DRI2);
+	maliSetupPixmapImg(&src_img, pSrcPixmap);
+	maliSetupPixmapImg(&dst_img, pDstPixmap);
+
+	/* the source seen from the destination */
+	maliPixmapBox(pDstPixmap, &dst_bounds);
+	maliPixmapBox(pSrcPixmap, &src_bounds);
+	src_bounds.x1 -= dx;
+	src_bounds.y1 -= dy;
+	src_bounds.x2 -= dx;
+	src_bounds.y2 -= dy;
+	maliBoxIntersect(&dst_bounds, &src_bounds);
+
+	for (i = 0; i < nbox; i++)
+	{
+		BoxRec box = pBoxes[i];
+
+		maliBoxIntersect(&box, &dst_bounds);
+		if (MALI_BOX_EMPTY(&box))
+			continue;
+
+		job = maliCopyRect(&src_img, &dst_img, box.x1 + dx, box.y1 + dy, box.x1, box.y1,
+				   box.x2 - box.x1, box.y2 - box.y1);
+		pixels += (box.x2 - box.x1) * (box.y2 - box.y1);
+		maliBoxUnion(&extents, &box);
+	}
+
+	if (job)
+	{
+		mi.copies++;
+		privSrc->read_job = job;
+		maliPixmapDeviceWrite(privDst, job, &extents);
+	}
+
+	return pixels;
+}
+
+static void maliStagingFree( void )
+{
+	int i;
 
+	for (i = 0; i < MALI_STAGING_BUFFERS; i++)
+	{
+		if (!mi.staging[i])
+			continue;
+
+		maliBltSchedWait(&mi.blt, mi.staging_job[i]);
+		maliHwmemRelease(mi.pool.fd, mi.staging[i]);
+		mi.staging[i] = NULL;
+		mi.staging_job[i] = 0;
+	}
+}
+
+/*
+ * Take the next buffer of the staging ring, once the blitter is done with
+ * what it last held. The buffers are cached and mapped for good, cache
+ * maintenance covers only the bytes used.
+ */
+static mali_mem_info *maliStagingNext( int *slot )
+{
+	int i = mi.staging_next;
+
+	if (!mi.staging[i])
+	{
+		mi.staging[i] = maliHwmemAlloc(mi.pool.fd, MALI_STAGING_SIZE, HWMEM_ALLOC_HINT_CACHED);
+		if (!mi.staging[i])
+			return NULL;
+
+		if (!maliHwmemMap(mi.pool.fd, mi.staging[i]))
+		{
+			maliHwmemRelease(mi.pool.fd, mi.staging[i]);
+			mi.staging[i] = NULL;
+			return NULL;
+		}
+	}
+
+	maliBltSchedWait(&mi.blt, mi.staging_job[i]);
+	mi.staging_job[i] = 0;
+	mi.staging_next = (i + 1) % MALI_STAGING_BUFFERS;
+	*slot = i;
+
+	return mi.staging[i];
+}
+
+static void maliSetupStagingImg( struct blt_img *img, mali_mem_info *staging, PixmapPtr pPixmap, int width, int height, int pitch )
+{
+	memset(img, 0, sizeof(*img));
+	img->fmt = maliGetColorFormat(pPixmap->drawable.bitsPerPixel);
+	img->buf.type = BLT_PTR_HWMEM_BUF_NAME_OFFSET;
+	img->buf.hwmem_buf_name = staging->hwmem_global_name;
+	img->width = width;
+	img->height = height;
+	img->pitch = pitch;
+}
+
+/* Staging pitch for width pixels, 0 when the transfer is not worth a blit */
+static int maliStagingPitch( PixmapPtr pPixmap, int width, int height )
+{
+	PrivPixmap *privPixmap = (PrivPixmap *)exaGetPixmapDriverPrivate(pPixmap);
+	int pitch = MALI_ALIGN(width * pPixmap->drawable.bitsPerPixel / 8, 8);
+
+	if (!privPixmap || !privPixmap->mem_info || pPixmap->drawable.bitsPerPixel <= 8)
+		return 0;
+
+	if (pitch * height < MALI_STAGING_MIN_SIZE || pitch > MALI_STAGING_SIZE)
+		return 0;
+
+	return pitch;
+}
+
+/*
+ * Uploads are copied into the staging ring band by band and left to the
+ * blitter, the server does not wait for them.
+ */
+static Bool maliUploadToScreen( PixmapPtr pDst, int x, int y, int w, int h, char *src, int src_pitch )
+{
+	PrivPixmap *privPixmap = (PrivPixmap *)exaGetPixmapDriverPrivate(pDst);
+	int cpp = pDst->drawable.bitsPerPixel / 8;
+	int pitch = maliStagingPitch(pDst, w, h);
+	struct blt_img src_img, dst_img;
+	int rows, band, i;
+
+	TRACE_ENTER();
+
+	if (!pitch)
+	{
+		mi.fallbacks[MALI_FALLBACK_UPLOAD]++;
+		TRACE_EXIT();
+		return FALSE;
+	}
+
+	rows = MALI_STAGING_SIZE / pitch;
+	maliSetupPixmapImg(&dst_img, pDst);
+	maliPixmapToDevice(pDst);
+	maliPickChannel(pDst, NULL, MALI_BLT_CLASS_UPLOAD);
+
+	for (; h > 0; y += band, h -= band)
+	{
+		mali_mem_info *staging;
+		unsigned char *dst;
+		BoxRec box;
+		MaliBltJob job;
+		int slot;
+
+		band = min(rows, h);
+
+		staging = maliStagingNext(&slot);
+		if (!staging)
+		{
+			TRACE_EXIT();
+			return FALSE;
+		}
+
+		dst = staging->addr;
+		for (i = 0; i < band; i++, src += src_pitch, dst += pitch)
+			memcpy(dst, src, w * cpp);
+		maliSetDomainRange(staging, HWMEM_SET_SYNC_DOMAIN_IOC, band * pitch);
+
+		maliSetupStagingImg(&src_img, staging, pDst, w, band, pitch);
+		job = maliCopyRect(&src_img, &dst_img, 0, 0, x, y, w, band);
+		if (!job)
+		{
+			TRACE_EXIT();
+			return FALSE;
+		}
+
+		box.x1 = x;
+		box.y1 = y;
+		box.x2 = x + w;
+		box.y2 = y + band;
+		maliPixmapDeviceWrite(privPixmap, job, &box);
+		mi.staging_job[slot] = job;
+		mi.upload_bytes += band * w * cpp;
+	}
+
+	mi.uploads++;
+	TRACE_EXIT();
+
+	return TRUE;
+}
+
+/*
+ * Readbacks keep the whole ring busy: while the CPU copies one band out,
+ * the blitter fills the following ones.
+ */
+static Bool maliDownloadFromScreen( PixmapPtr pSrc, int x, int y, int w, int h, char *dst, int dst_pitch )
+{
+	PrivPixmap *privPixmap = (PrivPixmap *)exaGetPixmapDriverPrivate(pSrc);
+	int cpp = pSrc->drawable.bitsPerPixel / 8;
+	int pitch = maliStagingPitch(pSrc, w, h);
+	struct blt_img src_img, dst_img;
+	int rows, submitted, copied, inflight, i;
+
+	TRACE_ENTER();
+
+	if (!pitch)
+	{
+		mi.fallbacks[MALI_FALLBACK_DOWNLOAD]++;
+		TRACE_EXIT();
+		return FALSE;
+	}
+
+	rows = MALI_STAGING_SIZE / pitch;
+	maliSetupPixmapImg(&src_img, pSrc);
+	maliPixmapToDevice(pSrc);
+	maliPickChannel(pSrc, NULL, MALI_BLT_CLASS_UPLOAD);
+
+	for (submitted = copied = inflight = 0; copied < h; )
+	{
+		int slot, band;
+		unsigned char *src;
+
+		/* keep the ring full */
+		while (submitted < h && inflight < MALI_STAGING_BUFFERS)
+		{
+			mali_mem_info *staging = maliStagingNext(&slot);
+			MaliBltJob job = 0;
+
+			band = min(rows, h - submitted);
+			if (staging)
+			{
+				maliSetupStagingImg(&dst_img, staging, pSrc, w, band, pitch);
+				job = maliCopyRect(&src_img, &dst_img, x, y + submitted, 0, 0, w, band);
+			}
+			if (!staging || !job)
+			{
+				TRACE_EXIT();
+				return FALSE;
+			}
+
+			privPixmap->read_job = maliLaterJob(privPixmap->read_job, job);
+			mi.staging_job[slot] = job;
+			submitted += band;
+			inflight++;
+		}
+
+		/* copy out the oldest band */
+		slot = (mi.staging_next + MALI_STAGING_BUFFERS - inflight) % MALI_STAGING_BUFFERS;
+		band = min(rows, h - copied);
+
+		maliBltSchedWait(&mi.blt, mi.staging_job[slot]);
+		mi.staging_job[slot] = 0;
+		maliSetDomainRange(mi.staging[slot], HWMEM_SET_CPU_DOMAIN_IOC, band * pitch);
+
+		src = mi.staging[slot]->addr;
+		for (i = 0; i < band; i++, src += pitch, dst += dst_pitch)
+			memcpy(dst, src, w * cpp);
+
+		copied += band;
+		inflight--;
+	}
+
+	mi.downloads++;
+	mi.download_bytes += h * w * cpp;
 	TRACE_EXIT();
+
+	return TRUE;
+}
+
+static void maliWaitMarker( ScreenPtr pScreen, int marker )
+{
+	TRACE_ENTER();
+	IGNORE( pScreen );
+	IGNORE( marker );
+
+	/* EXA calls this before every PrepareAccess with the last marker of the
+	 * screen. maliPrepareAccess waits for the jobs of the pixmap itself, so
+	 * unrelated blits keep running here. */
+
+	TRACE_EXIT();
+}
+
+/* Blits from now until the call with FALSE are part of a DRI2 swap */
+void maliExaSetDRI2Swap( Bool swapping )
+{
+	mi.dri2_swap = swapping;
+}
+
+/* Channel for Xv, NULL before EXA is set up */
+MaliBltPtr maliExaVideoChannel( void )
+{
+	return mi.blt.num_channels ? maliBltSchedVideo(&mi.blt) : NULL;
 }
 
-static void maliDoneCopy( PixmapPtr pDstPixmap )
+/* Record that another device wrote pBox of an exported pixmap */
+void maliPixmapDeviceWrote( PixmapPtr pPixmap, const BoxRec *pBox )
 {
-	TRACE_ENTER();
+	PrivPixmap *privPixmap = (PrivPixmap *)exaGetPixmapDriverPrivate(pPixmap);
+	BoxRec box;
 
-        if (mi.pGC) {
-                FreeScratchGC(mi.pGC);
-                mi.pGC = NULL;
-        }
-        (void)blt_synch(mi.blt_handle, 0);
+	if ( !privPixmap || !privPixmap->mem_info )
+		return;
 
-	IGNORE( pDstPixmap );
-	TRACE_EXIT();
+	maliPixmapBox(pPixmap, &box);
+	maliBoxIntersect(&box, pBox);
+	maliBoxUnion(&privPixmap->device_dirty, &box);
 }
 
-static void maliWaitMarker( ScreenPtr pScreen, int marker )
+void maliPixmapWaitIdle( PixmapPtr pPixmap )
 {
-	TRACE_ENTER();
-	IGNORE( pScreen );
-	IGNORE( marker );
-	TRACE_EXIT();
+	PrivPixmap *privPixmap = (PrivPixmap *)exaGetPixmapDriverPrivate(pPixmap);
+
+	if (privPixmap && privPixmap->mem_info)
+	{
+		maliPixmapWait(privPixmap, TRUE);
+		maliPixmapToDevice(pPixmap);
+	}
 }
 
 static void* maliCreatePixmap(ScreenPtr pScreen, int size, int align )
@@ -291,20 +1271,57 @@ static void maliDestroyPixmap(ScreenPtr pScreen, void *driverPriv )
 	IGNORE( pScreen );
 	if ( NULL != privPixmap->mem_info )
 	{
-		if (privPixmap->addr != NULL)
+		if ( privPixmap->isFrameBuffer )
 		{
-			munmap(privPixmap->addr, privPixmap->mem_info->usize);
+			/* the blitter may still be using the memory */
+			maliPixmapWait(privPixmap, TRUE);
+			maliHwmemRelease( mi.pool.fd, privPixmap->mem_info );
+			privPixmap->mem_info = NULL;
 		}
-		ioctl( (MALIPTR(xf86Screens[pScreen->myNum]))->hwmem_fd,
-			HWMEM_RELEASE_IOC, 
-			privPixmap->mem_info->hwmem_alloc);
-		free( privPixmap->mem_info );
-		privPixmap->mem_info = NULL;
-		free( privPixmap );
+		else
+			maliPixmapReleaseHwmem( privPixmap );
 	}
+	if ( privPixmap->in_sysmem )
+		free( privPixmap->addr );
+	free( privPixmap );
 	TRACE_EXIT();
 }
 
+static void maliSysmemFree( PixmapPtr pPixmap, PrivPixmap *privPixmap )
+{
+	free( privPixmap->addr );
+	privPixmap->addr = NULL;
+	privPixmap->in_sysmem = FALSE;
+	pPixmap->devPrivate.ptr = NULL;
+}
+
+/* (Re)allocate system memory backing, dropping any hwmem buffer */
+static Bool maliSysmemAlloc( PixmapPtr pPixmap, PrivPixmap *privPixmap, unsigned int size )
+{
+	void *addr;
+
+	if ( privPixmap->mem_info )
+		maliPixmapReleaseHwmem( privPixmap );
+
+	addr = realloc( privPixmap->in_sysmem ? privPixmap->addr : NULL, size );
+	if ( NULL == addr )
+	{
+		xf86DrvMsg(mi.pScrn->scrnIndex, X_ERROR, "[%s:%d] failed to allocate system memory (%i bytes)\n", __FUNCTION__, __LINE__, size);
+		if ( privPixmap->in_sysmem )
+			maliSysmemFree( pPixmap, privPixmap );
+		return FALSE;
+	}
+
+	if ( !privPixmap->in_sysmem )
+		mi.sysmem_pixmaps++;
+
+	privPixmap->in_sysmem = TRUE;
+	privPixmap->addr = addr;
+	pPixmap->devPrivate.ptr = addr;
+
+	return TRUE;
+}
+
 static Bool maliModifyPixmapHeader(PixmapPtr pPixmap, int width, int height, int depth, int bitsPerPixel, int devKind, pointer pPixData)
 {
 	unsigned int size;
@@ -356,7 +1373,7 @@ static Bool maliModifyPixmapHeader(PixmapPtr pPixmap, int width, int height, int
 			return FALSE;
 		}
 
-		mem_info->hwmem_alloc = ioctl(	MALIPTR(xf86Screens[pPixmap->drawable.pScreen->myNum])->hwmem_fd,
+		mem_info->hwmem_alloc = maliHwmemDevIoctl( MALIPTR(xf86Screens[pPixmap->drawable.pScreen->myNum])->hwmem_fd,
 						HWMEM_IMPORT_IOC,
 						secure_id);
 
@@ -373,10 +1390,14 @@ static Bool maliModifyPixmapHeader(PixmapPtr pPixmap, int width, int height, int
 
 		size = exaGetPixmapPitch(pPixmap) * pPixmap->drawable.height;
 		mem_info->usize = size;
+		mem_info->alloc_size = size;
 
 		privPixmap->mem_info = mem_info;
 		if( bitsPerPixel != 0 ) privPixmap->bits_per_pixel = bitsPerPixel;
 
+		/* the console may have left anything in the caches */
+		maliPixmapBox(pPixmap, &privPixmap->device_dirty);
+
 		TRACE_EXIT();
 		return TRUE;
 	}
@@ -402,27 +1423,31 @@ static Bool maliModifyPixmapHeader(PixmapPtr pPixmap, int width, int height, int
 
 	size = exaGetPixmapPitch(pPixmap) * pPixmap->drawable.height;
 
+	if ( size && maliPixmapUseSysmem( pPixmap ) )
+	{
+		Bool ret = maliSysmemAlloc( pPixmap, privPixmap, size );
+
+		TRACE_EXIT();
+		return ret;
+	}
+
+	if ( privPixmap->in_sysmem )
+		maliSysmemFree( pPixmap, privPixmap );
+
 	/* allocate pixmap data */
 	mem_info = privPixmap->mem_info;
 
-	if ( mem_info && mem_info->usize == size ) 
+	if ( mem_info && size != 0 && maliHwmemPoolClassSize( &mi.pool, size ) == mem_info->alloc_size ) 
 	{
+		mem_info->usize = size;
 		TRACE_EXIT();
 		return TRUE;
 	}
 
-	if ( mem_info && mem_info->usize != 0 )
+	if ( mem_info )
 	{
-		ioctl(	MALIPTR(xf86Screens[pPixmap->drawable.pScreen->myNum])->hwmem_fd,
-			HWMEM_RELEASE_IOC,
-			mem_info->hwmem_alloc);
-
-		mem_info->hwmem_alloc = 0;
-		mem_info->hwmem_global_name = 0;
-		memset(privPixmap, 0, sizeof(*privPixmap));
-
-		TRACE_EXIT();
-		return TRUE;
+		/* hand the old buffer back, its contents are undefined after a resize */
+		maliPixmapReleaseHwmem( privPixmap );
 	}
 
 	if (!size) 
@@ -431,50 +1456,15 @@ static Bool maliModifyPixmapHeader(PixmapPtr pPixmap, int width, int height, int
 		return TRUE;
 	}
 
+	mem_info = maliHwmemPoolAlloc( &mi.pool, size );
 	if ( NULL == mem_info )
 	{
-		mem_info = calloc(1, sizeof(*mem_info));
-		if (!mem_info) 
-		{
-			xf86DrvMsg(mi.pScrn->scrnIndex, X_ERROR, "[%s:%d] failed to allocate memory metadata\n", __FUNCTION__, __LINE__);
-			TRACE_EXIT();
-			return FALSE;
-		}
-	}
-
-	{
-		struct hwmem_alloc_request args;
-		args.size = size;
-		args.flags = HWMEM_ALLOC_HINT_CACHED;
-		args.default_access = HWMEM_ACCESS_READ | HWMEM_ACCESS_WRITE | HWMEM_ACCESS_IMPORT;
-		args.mem_type = HWMEM_MEM_CONTIGUOUS_SYS;
-		mem_info->hwmem_alloc = ioctl(	MALIPTR(xf86Screens[pPixmap->drawable.pScreen->myNum])->hwmem_fd,
-						HWMEM_ALLOC_IOC,
-						&args);
-
-		if ( 0 == mem_info->hwmem_alloc )
-		{
-			xf86DrvMsg(mi.pScrn->scrnIndex, X_ERROR, "[%s:%d] failed to allocate hwmem memory (%i bytes)\n", __FUNCTION__, __LINE__, size);
-			TRACE_EXIT();
-			return FALSE;
-		}
-
-	}
-
-	mem_info->hwmem_global_name = ioctl(  	MALIPTR(xf86Screens[pPixmap->drawable.pScreen->myNum])->hwmem_fd,
-						HWMEM_EXPORT_IOC,
-						mem_info->hwmem_alloc);
-
-	if ( 0 == mem_info->hwmem_global_name )
-	{
-		xf86DrvMsg(mi.pScrn->scrnIndex, X_ERROR, "[%s:%d] failed to export global hwmem name\n", __FUNCTION__, __LINE__);
-		TRACE_EXIT();		
+		xf86DrvMsg(mi.pScrn->scrnIndex, X_ERROR, "[%s:%d] failed to allocate hwmem memory (%i bytes)\n", __FUNCTION__, __LINE__, size);
+		TRACE_EXIT();
 		return FALSE;
 	}
 
-	mem_info->usize = size;
 	privPixmap->mem_info = mem_info;
-	privPixmap->mem_info->usize = size;
 	privPixmap->addr = NULL;
 	privPixmap->bits_per_pixel = 16;
 
@@ -499,7 +1489,7 @@ static Bool maliPixmapIsOffscreen( PixmapPtr pPix )
 	if ( privPixmap )
 	{
 		TRACE_EXIT();
-		return pPix->devPrivate.ptr ? FALSE : TRUE;
+		return privPixmap->in_sysmem || pPix->devPrivate.ptr ? FALSE : TRUE;
 	}
 
 	TRACE_EXIT();
@@ -507,13 +1497,65 @@ static Bool maliPixmapIsOffscreen( PixmapPtr pPix )
 	return FALSE;
 }
 
+/*
+ * Make sure a pixmap has an hwmem buffer and mark it exported, for the
+ * users that hand its global name out (DRI2 buffers, Xv destinations).
+ * System memory pixmaps move into a buffer first.
+ */
+Bool maliPixmapEnsureHwmem( PixmapPtr pPixmap )
+{
+	PrivPixmap *privPixmap = (PrivPixmap *)exaGetPixmapDriverPrivate(pPixmap);
+	mali_mem_info *mem_info;
+	unsigned int size;
+	void *addr;
+
+	if ( !privPixmap )
+		return FALSE;
+
+	if ( !privPixmap->in_sysmem )
+	{
+		if ( NULL == privPixmap->mem_info )
+			return FALSE;
+
+		privPixmap->exported = TRUE;
+		return TRUE;
+	}
+
+	size = exaGetPixmapPitch(pPixmap) * pPixmap->drawable.height;
+	mem_info = maliHwmemPoolAlloc( &mi.pool, size );
+	if ( NULL == mem_info )
+	{
+		xf86DrvMsg(mi.pScrn->scrnIndex, X_ERROR, "[%s:%d] failed to allocate hwmem memory (%i bytes)\n", __FUNCTION__, __LINE__, size);
+		return FALSE;
+	}
+
+	addr = maliHwmemMap( mi.pool.fd, mem_info );
+	if ( NULL == addr )
+	{
+		xf86DrvMsg(mi.pScrn->scrnIndex, X_ERROR, "[%s:%d] failed to map hwmem memory\n", __FUNCTION__, __LINE__);
+		maliHwmemPoolFree( &mi.pool, mem_info );
+		return FALSE;
+	}
+
+	privPixmap->mem_info = mem_info;
+	privPixmap->exported = TRUE;
+	maliPixmapToCpu( pPixmap, TRUE, NULL );
+	memcpy( addr, privPixmap->addr, size );
+
+	maliSysmemFree( pPixmap, privPixmap );
+	privPixmap->bits_per_pixel = 16;
+
+	return TRUE;
+}
+
 static Bool maliPrepareAccess(PixmapPtr pPix, int index)
 {
 	PrivPixmap *privPixmap = (PrivPixmap *)exaGetPixmapDriverPrivate(pPix);
 	mali_mem_info *mem_info;
+	Bool write;
+	BoxRec access;
 
 	TRACE_ENTER();
-	IGNORE( index );
 
 	if ( !privPixmap ) 
 	{
@@ -522,30 +1564,27 @@ static Bool maliPrepareAccess(PixmapPtr pPix, int index)
 		return FALSE;
 	}
 
+	/* the access region only applies to this call */
+	access = privPixmap->access;
+	memset(&privPixmap->access, 0, sizeof(BoxRec));
 
-	mem_info = privPixmap->mem_info;
-	if ( NULL != mem_info )
+	if ( privPixmap->in_sysmem )
 	{
-		struct hwmem_set_domain_request args;
-		args.id = mem_info->hwmem_alloc;
-		args.access = HWMEM_ACCESS_READ | HWMEM_ACCESS_WRITE | HWMEM_ACCESS_IMPORT;
+		pPix->devPrivate.ptr = privPixmap->addr;
+		TRACE_EXIT();
+		return TRUE;
+	}
 
-		/* using memset avoids API compatibility problems with the skip/offset field. */
-		/* skip/offset = 0; start = 0; */
-		memset(&args.region, 0, sizeof(args.region));
-		args.region.count = 1;
-		args.region.end = mem_info->usize;
-		args.region.size = mem_info->usize;
-		ioctl(	MALIPTR(xf86Screens[pPix->drawable.pScreen->myNum])->hwmem_fd,
-			HWMEM_SET_CPU_DOMAIN_IOC,
-			&args);
+	/* sources are only read by fb, the rest may be written as well */
+	write = !(index == EXA_PREPARE_SRC || index == EXA_PREPARE_MASK ||
+		  index == EXA_PREPARE_AUX_SRC || index == EXA_PREPARE_AUX_MASK);
 
-		if (!privPixmap->addr)
-		{
-			privPixmap->addr = mmap(NULL, mem_info->usize, PROT_READ | PROT_WRITE,
-						MAP_SHARED, MALIPTR(xf86Screens[pPix->drawable.pScreen->myNum])->hwmem_fd,
-						(off_t)mem_info->hwmem_alloc);
-		}
+	mem_info = privPixmap->mem_info;
+	if ( NULL != mem_info )
+	{
+		maliPixmapWait(privPixmap, write);
+		maliPixmapToCpu(pPix, write, MALI_BOX_EMPTY(&access) ? NULL : &access);
+		privPixmap->addr = maliHwmemMap(mi.pool.fd, mem_info);
 	}
 	else
 	{
@@ -586,50 +1625,202 @@ static void maliFinishAccess(PixmapPtr pPix, int index)
 		return;
 	}
 
-	pPix->devPrivate.ptr = NULL;
+	if ( !privPixmap->in_sysmem )
+		pPix->devPrivate.ptr = NULL;
 
 	TRACE_EXIT();
 }
 
+/*
+ * Render acceleration on B2R2. Everything not listed falls back to EXA's
+ * software path.
+ *
+ *   op    source               mask                  destination
+ *   Src   a8r8g8b8, r5g6b5     none                  a8r8g8b8, x8r8g8b8, r5g6b5
+ *   Src   x8r8g8b8             none                  x8r8g8b8, r5g6b5
+ *   Over  a8r8g8b8             none, global alpha    a8r8g8b8, x8r8g8b8, r5g6b5
+ *   Over  x8r8g8b8             none, global alpha    x8r8g8b8, r5g6b5
+ *   Over  r5g6b5               none, global alpha    a8r8g8b8, x8r8g8b8, r5g6b5
+ *
+ * "global alpha" is a mask that is constant over the whole operation: a
+ * solid fill picture or a repeating 1x1 a8/a8r8g8b8 pixmap, without
+ * component alpha. Its alpha becomes the blitter's global_alpha.
+ *
+ * Sources must be untransformed, non-repeating pixmaps and no picture may
+ * carry an alpha map. Render pixels are premultiplied, which is what the
+ * blitter assumes for per-pixel alpha blending. Over from a source without
+ * alpha is a plain copy unless a global alpha applies.
+ */
+static int maliGetPictFormat( CARD32 format )
+{
+	switch (format) {
+		case PICT_a8r8g8b8:
+		case PICT_x8r8g8b8:
+			return BLT_FMT_32_BIT_ARGB8888;
+		case PICT_r5g6b5:
+			return BLT_FMT_16_BIT_RGB565;
+		default:
+			return BLT_FMT_UNUSED;
+	}
+}
+
+static Bool maliCheckCompositeMask( PicturePtr pMaskPicture )
+{
+	if (pMaskPicture->componentAlpha || pMaskPicture->alphaMap || pMaskPicture->transform)
+		return FALSE;
+
+	if (!pMaskPicture->pDrawable)
+		return pMaskPicture->pSourcePict && pMaskPicture->pSourcePict->type == SourcePictTypeSolidFill;
+
+	return pMaskPicture->repeat &&
+	       pMaskPicture->pDrawable->width == 1 && pMaskPicture->pDrawable->height == 1 &&
+	       (pMaskPicture->format == PICT_a8 || pMaskPicture->format == PICT_a8r8g8b8);
+}
+
 static Bool maliCheckComposite( int op, PicturePtr pSrcPicture, PicturePtr pMaskPicture, PicturePtr pDstPicture )
 {
 	TRACE_ENTER();
-	IGNORE( op );
-	IGNORE( pSrcPicture );
-	IGNORE( pMaskPicture );
-	IGNORE( pDstPicture );
+
+	if (op != PictOpSrc && op != PictOpOver)
+		goto unsupported;
+
+	if (!pSrcPicture->pDrawable || pSrcPicture->repeat || pSrcPicture->transform || pSrcPicture->alphaMap)
+		goto unsupported;
+
+	if (pDstPicture->alphaMap)
+		goto unsupported;
+
+	if (maliGetPictFormat(pSrcPicture->format) == BLT_FMT_UNUSED ||
+	    maliGetPictFormat(pDstPicture->format) == BLT_FMT_UNUSED)
+		goto unsupported;
+
+	/* the undefined x channel would end up as, or blend into, destination alpha */
+	if (pSrcPicture->format == PICT_x8r8g8b8 && pDstPicture->format == PICT_a8r8g8b8)
+		goto unsupported;
+
+	if (pMaskPicture && (op != PictOpOver || !maliCheckCompositeMask(pMaskPicture)))
+		goto unsupported;
+
 	TRACE_EXIT();
+	return TRUE;
 
+unsupported:
+	mi.fallbacks[MALI_FALLBACK_COMPOSITE_UNSUPPORTED]++;
+	TRACE_EXIT();
 	return FALSE;
 }
 
+static int maliGetMaskAlpha( PicturePtr pMaskPicture, PixmapPtr pMask )
+{
+	int alpha;
+
+	if (!pMaskPicture)
+		return 0xff;
+
+	if (!pMaskPicture->pDrawable)
+		return pMaskPicture->pSourcePict->solidFill.color >> 24;
+
+	if (!pMask)
+		return -1;
+
+	maliSetAccessRegion(pMask, 0, 0, 1, 1);
+	if (!maliPrepareAccess(pMask, EXA_PREPARE_MASK))
+		return -1;
+
+	if (pMaskPicture->format == PICT_a8)
+		alpha = *(CARD8 *)pMask->devPrivate.ptr;
+	else
+		alpha = *(CARD32 *)pMask->devPrivate.ptr >> 24;
+
+	maliFinishAccess(pMask, EXA_PREPARE_MASK);
+
+	return alpha;
+}
+
 static Bool maliPrepareComposite( int op, PicturePtr pSrcPicture, PicturePtr pMaskPicture, PicturePtr pDstPicture, PixmapPtr pSrcPixmap, PixmapPtr pMask, PixmapPtr pDstPixmap )
 {
+	struct blt_req *bltreq = &mi.composite_req;
+	int alpha;
+
 	TRACE_ENTER();
-	IGNORE( op );
-	IGNORE( pSrcPicture );
-	IGNORE( pMaskPicture );
-	IGNORE( pDstPicture );
-	IGNORE( pSrcPixmap );
-	IGNORE( pMask );
-	IGNORE( pDstPixmap );
+
+	if (pSrcPixmap == pDstPixmap || maliPixmapInSysmem(pSrcPixmap) || maliPixmapInSysmem(pDstPixmap))
+	{
+		mi.fallbacks[MALI_FALLBACK_COMPOSITE_PIXMAP]++;
+		TRACE_EXIT();
+		return FALSE;
+	}
+
+	alpha = maliGetMaskAlpha(pMaskPicture, pMask);
+	if (alpha < 0)
+	{
+		mi.fallbacks[MALI_FALLBACK_COMPOSITE_MASK]++;
+		TRACE_EXIT();
+		return FALSE;
+	}
+
+	memset(bltreq, 0, sizeof(*bltreq));
+	bltreq->size = sizeof(struct blt_req);
+	bltreq->flags = MALI_BLT_FLAGS;
+	bltreq->transform = BLT_TRANSFORM_NONE;
+
+	maliSetupPixmapImg(&bltreq->src_img, pSrcPixmap);
+	bltreq->src_img.fmt = maliGetPictFormat(pSrcPicture->format);
+	maliSetupPixmapImg(&bltreq->dst_img, pDstPixmap);
+	bltreq->dst_img.fmt = maliGetPictFormat(pDstPicture->format);
+
+	maliPixmapToDevice(pSrcPixmap);
+	maliPixmapToDevice(pDstPixmap);
+	maliPickChannel(pSrcPixmap, pDstPixmap, MALI_BLT_CLASS_COPY);
+
+	if (op == PictOpOver)
+	{
+		if (PICT_FORMAT_A(pSrcPicture->format))
+			bltreq->flags |= BLT_FLAG_PER_PIXEL_ALPHA_BLEND;
+
+		if (alpha < 0xff)
+		{
+			bltreq->flags |= BLT_FLAG_GLOBAL_ALPHA_BLEND;
+			bltreq->global_alpha = alpha;
+		}
+	}
+
+	mi.pSourcePixmap = pSrcPixmap;
+
 	TRACE_EXIT();
 
-	return FALSE;
+	return TRUE;
 }
 
 static void maliComposite( PixmapPtr pDstPixmap, int srcX, int srcY, int maskX, int maskY, int dstX, int dstY, int width, int height)
 {
+	struct blt_req *bltreq = &mi.composite_req;
+	MaliBltJob job;
+
 	TRACE_ENTER();
-	IGNORE( pDstPixmap );
-	IGNORE( srcX );
-	IGNORE( srcY );
 	IGNORE( maskX );
 	IGNORE( maskY );
-	IGNORE( dstX );
-	IGNORE( dstY );
-	IGNORE( width );
-	IGNORE( height );
+
+	bltreq->src_rect.x = srcX;
+	bltreq->src_rect.y = srcY;
+	bltreq->src_rect.width = width;
+	bltreq->src_rect.height = height;
+	bltreq->dst_rect.x = dstX;
+	bltreq->dst_rect.y = dstY;
+	bltreq->dst_rect.width = width;
+	bltreq->dst_rect.height = height;
+	bltreq->dst_clip_rect = bltreq->dst_rect;
+
+	job = maliBltSubmit(mi.channel, bltreq, mi.blt_class);
+	if (job)
+	{
+		BoxRec box = { dstX, dstY, dstX + width, dstY + height };
+
+		mi.composites++;
+		((PrivPixmap *)exaGetPixmapDriverPrivate(mi.pSourcePixmap))->read_job = job;
+		maliPixmapDeviceWrite((PrivPixmap *)exaGetPixmapDriverPrivate(pDstPixmap), job, &box);
+	}
+
 	TRACE_EXIT();
 }
 
@@ -637,6 +1828,9 @@ static void maliDoneComposite( PixmapPtr pDst )
 {
 	TRACE_ENTER();
 	IGNORE( pDst );
+
+	mi.pSourcePixmap = NULL;
+
 	TRACE_EXIT();
 }
 
@@ -646,10 +1840,250 @@ static void maliDumpInfo()
 	xf86DrvMsg(mi.pScrn->scrnIndex, X_INFO, "XRES: %i YRES: %i PHYS: 0x%x VIRT: 0x%x\n", mi.fb_xres, mi.fb_yres, (int)mi.fb_phys, (int)mi.fb_virt);
 }
 
+static const char *maliFallbackNames[MALI_NUM_FALLBACKS] = {
+	"fallback_solid_depth",
+	"fallback_solid_sysmem",
+	"fallback_copy_depth",
+	"fallback_copy_sysmem",
+	"fallback_copy_overlap",
+	"fallback_composite_unsupported",
+	"fallback_composite_pixmap",
+	"fallback_composite_mask",
+	"fallback_upload",
+	"fallback_download"
+};
+
+/* Counters as "name=value" lines, returns the length snprintf would have written */
+int maliExaPrintStats( char *buf, int size )
+{
+	MaliBltRec blt;
+	int len, i;
+
+	maliBltSchedStats(&mi.blt, &blt);
+
+	len = snprintf(buf, size,
+		       "solid_rects=%lu\nsolid_blits=%lu\ncopies=%lu\ncomposites=%lu\n"
+		       "uploads=%lu\nupload_bytes=%lu\ndownloads=%lu\ndownload_bytes=%lu\n"
+		       "blt_submitted=%lu\nblt_failed=%lu\nblt_bytes=%llu\nblt_waits=%lu\n"
+		       "blt_stalls=%lu\nblt_stall_us=%llu\n"
+		       "hwmem_live_bytes=%lu\nhwmem_peak_bytes=%lu\nhwmem_cached_bytes=%lu\n"
+		       "domain_syncs=%lu\ndomain_sync_bytes=%lu\nsysmem_pixmaps=%lu\n"
+		       "blt_channels=%d\nblt_cross_waits=%lu\n",
+		       mi.solid_rects, mi.solid_requests, mi.copies, mi.composites,
+		       mi.uploads, mi.upload_bytes, mi.downloads, mi.download_bytes,
+		       blt.submitted, blt.failed, (unsigned long long)blt.bytes, blt.waits,
+		       blt.stalls, (unsigned long long)(blt.stall_ns / 1000),
+		       mi.pool.live_bytes, mi.pool.peak_bytes, mi.pool.cached_bytes,
+		       mi.domain_syncs, mi.domain_sync_bytes, mi.sysmem_pixmaps,
+		       mi.blt.num_channels, mi.blt.cross_waits);
+
+	for (i = 0; i < mi.blt.num_channels; i++)
+		len += snprintf(buf + min(len, size), size - min(len, size), "blt_channel%d_submitted=%lu\n", i, mi.blt.channel[i].submitted);
+
+	/* averages in us, the complete time of jobs still in flight is not in yet */
+	for (i = 0; i < MALI_BLT_NUM_CLASSES; i++)
+	{
+		MaliBltLatency *latency = &blt.latency[i];
+		unsigned long jobs = max(latency->jobs, 1);
+
+		len += snprintf(buf + min(len, size), size - min(len, size),
+				"blt_%s_jobs=%lu\nblt_%s_queue_us=%llu\nblt_%s_queue_max_us=%llu\nblt_%s_complete_us=%llu\n",
+				maliBltClassName(i), latency->jobs,
+				maliBltClassName(i), (unsigned long long)(latency->queue_ns / jobs / 1000),
+				maliBltClassName(i), (unsigned long long)(latency->queue_max_ns / 1000),
+				maliBltClassName(i), (unsigned long long)(latency->complete_ns / jobs / 1000));
+	}
+
+	for (i = 0; i < MALI_COST_NUM_KERNELS; i++)
+		len += snprintf(buf + min(len, size), size - min(len, size), "dispatch_%s_hw=%lu\ndispatch_%s_cpu=%lu\n",
+				maliCostKernelName(i), mi.dispatch_hw[i], maliCostKernelName(i), mi.dispatch_cpu[i]);
+	if (mi.dispatch)
+		len += maliCostPrint(&mi.cost, buf + min(len, size), size - min(len, size));
+
+	for (i = 0; i < MALI_NUM_FALLBACKS; i++)
+		len += snprintf(buf + min(len, size), size - min(len, size), "%s=%lu\n", maliFallbackNames[i], mi.fallbacks[i]);
+
+	return len;
+}
+
+void maliCloseExa( ScreenPtr pScreen )
+{
+	MaliBltRec blt;
+
+	IGNORE( pScreen );
+
+	maliBltSchedStats(&mi.blt, &blt);
+
+	if (mi.solid_flushes)
+		xf86DrvMsg(mi.pScrn->scrnIndex, X_INFO, "Solid fills: %lu rectangles in %lu blits over %lu submissions (%lu rectangles/submission)\n",
+			   mi.solid_rects, mi.solid_requests, mi.solid_flushes, mi.solid_rects / mi.solid_flushes);
+
+	if (mi.copy_bands || mi.copy_bounces)
+		xf86DrvMsg(mi.pScrn->scrnIndex, X_INFO, "Overlapping copies: %lu split into bands, %lu bounced\n",
+			   mi.copy_bands, mi.copy_bounces);
+
+	if (mi.sysmem_pixmaps)
+		xf86DrvMsg(mi.pScrn->scrnIndex, X_INFO, "%lu pixmaps placed in system memory\n", mi.sysmem_pixmaps);
+
+	if (mi.uploads || mi.downloads)
+		xf86DrvMsg(mi.pScrn->scrnIndex, X_INFO, "Staged transfers: %lu uploads (%lu kB), %lu downloads (%lu kB)\n",
+			   mi.uploads, mi.upload_bytes / 1024, mi.downloads, mi.download_bytes / 1024);
+
+	if (mi.domain_syncs || mi.domain_syncs_skipped)
+		xf86DrvMsg(mi.pScrn->scrnIndex, X_INFO, "Cache maintenance: %lu domain changes over %lu kB, %lu avoided\n",
+			   mi.domain_syncs, mi.domain_sync_bytes / 1024, mi.domain_syncs_skipped);
+
+	if (blt.stalls)
+		xf86DrvMsg(mi.pScrn->scrnIndex, X_INFO, "Blitter backpressure: %lu submissions waited %llu ms in total\n",
+			   blt.stalls, (unsigned long long)(blt.stall_ns / 1000000));
+
+	if (mi.blt.cross_waits)
+		xf86DrvMsg(mi.pScrn->scrnIndex, X_INFO, "Blitter channels: %lu waits for work on another channel\n", mi.blt.cross_waits);
+
+	if (mi.pool.hits || mi.pool.misses)
+		xf86DrvMsg(mi.pScrn->scrnIndex, X_INFO, "hwmem pool: %lu hits, %lu misses, %lu releases, %lu bytes cached\n",
+			   mi.pool.hits, mi.pool.misses, mi.pool.releases, mi.pool.cached_bytes);
+
+	maliScratchFree();
+	maliStagingFree();
+	maliBltSchedClose(&mi.blt);
+	maliHwmemPoolFini(&mi.pool);
+}
+
+/* Average ns of reps fills or copies of width x height on the blitter */
+static CARD64 maliCalibrateHw( MaliCostKernel kernel, struct blt_img *img, int width, int height, int reps )
+{
+	struct blt_req bltreq = {0};
+	CARD64 start = maliTraceNow();
+	int i;
+
+	bltreq.size = sizeof(struct blt_req);
+	bltreq.flags = MALI_BLT_FLAGS | BLT_FLAG_SOURCE_FILL_RAW;
+	bltreq.transform = BLT_TRANSFORM_NONE;
+	bltreq.dst_img = *img;
+	bltreq.dst_rect.y = img->height / 2;
+	bltreq.dst_rect.width = width;
+	bltreq.dst_rect.height = height;
+	bltreq.dst_clip_rect = bltreq.dst_rect;
+
+	for (i = 0; i < reps; i++)
+	{
+		if (kernel == MALI_COST_FILL)
+			(void)maliBltSubmit(mi.channel, &bltreq, MALI_BLT_CLASS_FILL);
+		else
+			(void)maliCopyRect(img, img, 0, 0, 0, img->height / 2, width, height);
+	}
+	maliBltSchedWaitAll(&mi.blt);
+
+	return (maliTraceNow() - start) / reps;
+}
+
+/* The same with pixman, on the CPU mapping of the buffer */
+static CARD64 maliCalibrateCpu( MaliCostKernel kernel, uint32_t *bits, struct blt_img *img, int width, int height, int reps )
+{
+	CARD64 start = maliTraceNow();
+	int i;
+
+	for (i = 0; i < reps; i++)
+	{
+		if (kernel == MALI_COST_FILL)
+			pixman_fill(bits, img->pitch / 4, 32, 0, img->height / 2, width, height, i);
+		else
+			pixman_blt(bits, bits, img->pitch / 4, img->pitch / 4, 32, 32, 0, 0, 0, img->height / 2, width, height);
+	}
+
+	return (maliTraceNow() - start) / reps;
+}
+
+/*
+ * Fit the cost models to fills and copies of a small, a large and a tall
+ * rectangle, timed on the blitter and with pixman in a cached buffer like
+ * those of pixmaps. Copies go from the top half of the buffer to the
+ * bottom half. Every shape runs once untimed to fault the pages in.
+ */
+static Bool maliCalibrate( void )
+{
+	static const int shapes[MALI_COST_NUM_SAMPLES][2] = { { 16, 16 }, { 256, 256 }, { 2, 256 } };
+	MaliCostSample samples[MALI_COST_NUM_SAMPLES];
+	struct blt_img img;
+	mali_mem_info *mem;
+	uint32_t *bits;
+	int k, s;
+
+	memset(&img, 0, sizeof(img));
+	img.fmt = BLT_FMT_32_BIT_ARGB8888;
+	img.buf.type = BLT_PTR_HWMEM_BUF_NAME_OFFSET;
+	img.width = 256;
+	img.height = 2 * 256;
+	img.pitch = img.width * 4;
+
+	mem = maliHwmemAlloc(mi.pool.fd, (unsigned long)img.pitch * img.height, HWMEM_ALLOC_HINT_CACHED);
+	if (!mem)
+		return FALSE;
+
+	bits = maliHwmemMap(mi.pool.fd, mem);
+	if (!bits)
+	{
+		maliHwmemRelease(mi.pool.fd, mem);
+		return FALSE;
+	}
+	img.buf.hwmem_buf_name = mem->hwmem_global_name;
+
+	mi.channel = &mi.blt.channel[0];
+	for (k = 0; k < MALI_COST_NUM_KERNELS; k++)
+	{
+		mi.blt_class = k == MALI_COST_FILL ? MALI_BLT_CLASS_FILL : MALI_BLT_CLASS_COPY;
+
+		for (s = 0; s < MALI_COST_NUM_SAMPLES; s++)
+		{
+			int width = shapes[s][0], height = shapes[s][1];
+			int reps = width * height < 4096 ? 64 : 8;
+
+			(void)maliCalibrateHw(k, &img, width, height, 1);
+			(void)maliCalibrateCpu(k, bits, &img, width, height, 1);
+
+			samples[s].rows = height;
+			samples[s].bytes = width * height * 4;
+			samples[s].hw_ns = maliCalibrateHw(k, &img, width, height, reps);
+			samples[s].cpu_ns = maliCalibrateCpu(k, bits, &img, width, height, reps);
+		}
+
+		maliCostFit(&mi.cost.model[k], samples);
+	}
+
+	/* dirty lines evicted later would corrupt the next user of the memory */
+	maliSetDomainRange(mem, HWMEM_SET_SYNC_DOMAIN_IOC, mem->usize);
+	maliHwmemRelease(mi.pool.fd, mem);
+
+	return TRUE;
+}
+
+/* Cost models from the profile if it has them, measured (and saved there) if not */
+static void maliSetupDispatch( const char *profile )
+{
+	int k;
+
+	if (profile && maliCostLoad(&mi.cost, profile))
+		xf86DrvMsg(mi.pScrn->scrnIndex, X_INFO, "Blitter cost profile loaded from %s\n", profile);
+	else if (!maliCalibrate())
+	{
+		xf86DrvMsg(mi.pScrn->scrnIndex, X_WARNING, "[%s:%d] blitter calibration failed, not dispatching to the CPU\n", __FUNCTION__, __LINE__);
+		mi.dispatch = FALSE;
+		return;
+	}
+	else if (profile && !maliCostSave(&mi.cost, profile))
+		xf86DrvMsg(mi.pScrn->scrnIndex, X_WARNING, "[%s:%d] failed to write cost profile %s\n", __FUNCTION__, __LINE__, profile);
+
+	for (k = 0; k < MALI_COST_NUM_KERNELS; k++)
+		xf86DrvMsg(mi.pScrn->scrnIndex, X_INFO, "CPU takes %s operations up to %i pixels (square, 32 bpp)\n",
+			   maliCostKernelName(k), maliCostCrossover(&mi.cost.model[k], 4));
+}
+
 Bool maliSetupExa( ScreenPtr pScreen, ExaDriverPtr exa, int xres, int yres, unsigned char *virt )
 {
 	ScrnInfoPtr pScrn = xf86Screens[pScreen->myNum];
 	MaliPtr fPtr = MALIPTR(pScrn);
+	int i;
 
 	if ( NULL == exa ) return FALSE;
 
@@ -659,6 +2093,8 @@ Bool maliSetupExa( ScreenPtr pScreen, ExaDriverPtr exa, int xres, int yres, unsi
 	mi.fb_yres = yres;
 	mi.fb_phys = pScrn->memPhysBase;
 	mi.fb_virt = virt;
+	mi.sysmem_area = fPtr->sysmem_pixmap_area;
+	mi.trace = &fPtr->trace;
 
 	TRACE_ENTER();
 
@@ -692,6 +2128,9 @@ Bool maliSetupExa( ScreenPtr pScreen, ExaDriverPtr exa, int xres, int yres, unsi
 	MALI_EXA_FUNC(Composite);
 	MALI_EXA_FUNC(DoneComposite);
 
+	MALI_EXA_FUNC(UploadToScreen);
+	MALI_EXA_FUNC(DownloadFromScreen);
+
 	MALI_EXA_FUNC(WaitMarker);
 
 	MALI_EXA_FUNC(CreatePixmap);
@@ -702,9 +2141,24 @@ Bool maliSetupExa( ScreenPtr pScreen, ExaDriverPtr exa, int xres, int yres, unsi
 	MALI_EXA_FUNC(PrepareAccess);
 	MALI_EXA_FUNC(FinishAccess);
 
-	mi.blt_handle = blt_open();
-	if (mi.blt_handle < 0)
+	if (!maliBltSchedOpen(&mi.blt, fPtr->blt_channels, fPtr->blt_video_channel, fPtr->blt_thread, fPtr->blt_inflight))
 		return FALSE;
+	for (i = 0; i < mi.blt.num_channels; i++)
+		mi.blt.channel[i].trace = mi.trace;
+	maliBltSchedSetPriorities(&mi.blt, fPtr->blt_prio);
+	mi.channel = &mi.blt.channel[0];
+	mi.blt_class = MALI_BLT_CLASS_COPY;
+
+	if (mi.blt.num_channels > 1)
+		xf86DrvMsg(mi.pScrn->scrnIndex, X_INFO, "Blitting over %i channels, %i of them for video\n",
+			   mi.blt.num_channels, mi.blt.num_channels - mi.blt.num_ui);
+
+	maliHwmemPoolInit(&mi.pool, fPtr->hwmem_fd, fPtr->hwmem_pool_size);
+	mi.pool.trace = mi.trace;
+
+	mi.dispatch = fPtr->dispatch;
+	if (mi.dispatch)
+		maliSetupDispatch(fPtr->dispatch_profile);
 
 	xf86DrvMsg(mi.pScrn->scrnIndex, X_INFO, "Mali EXA driver is loaded successfully\n");
 	TRACE_EXIT();
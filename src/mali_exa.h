@@ -25,6 +25,41 @@
 
 #include "xf86.h"
 #include "exa.h"
+#include "mali_blt.h"
+#include "mali_hwmem.h"
+#include "mali_cost.h"
+
+/* Maximum number of rectangles queued by maliSolid before a flush */
+#define MALI_SOLID_BATCH_SIZE 64
+
+/* Pixmap caches are maintained by the driver, see maliPixmapToDevice */
+#define MALI_BLT_FLAGS ( BLT_FLAG_ASYNCH | BLT_FLAG_SRC_NO_CACHE_FLUSH | BLT_FLAG_DST_NO_CACHE_FLUSH )
+
+/* Staging ring used by UploadToScreen and DownloadFromScreen */
+#define MALI_STAGING_BUFFERS 4
+#define MALI_STAGING_SIZE ( 512 * 1024 )
+
+/* Smaller transfers are left to the CPU through PrepareAccess */
+#define MALI_STAGING_MIN_SIZE ( 16 * 1024 )
+
+/* Overlapping copies needing more bands than this use the scratch buffer */
+#define MALI_COPY_MAX_BANDS 32
+
+/* Reasons for handing an operation back to EXA's software path */
+typedef enum
+{
+	MALI_FALLBACK_SOLID_DEPTH,
+	MALI_FALLBACK_SOLID_SYSMEM,
+	MALI_FALLBACK_COPY_DEPTH,
+	MALI_FALLBACK_COPY_SYSMEM,
+	MALI_FALLBACK_COPY_OVERLAP,
+	MALI_FALLBACK_COMPOSITE_UNSUPPORTED,
+	MALI_FALLBACK_COMPOSITE_PIXMAP,
+	MALI_FALLBACK_COMPOSITE_MASK,
+	MALI_FALLBACK_UPLOAD,
+	MALI_FALLBACK_DOWNLOAD,
+	MALI_NUM_FALLBACKS
+} MaliFallback;
 
 struct mali_info 
 {
@@ -34,26 +69,81 @@ struct mali_info
 	int fb_xres;
 	int fb_yres;
 	int fd;
-	int blt_handle;
+	MaliBltSchedRec blt;
+	MaliBltPtr channel;	/* of the operation under way, see maliPickChannel */
+	MaliBltClass blt_class;
+	Bool dri2_swap;
+	MaliHwmemPoolRec pool;
+	MaliTracePtr trace;
+	int sysmem_area;
+	unsigned long sysmem_pixmaps;
+	unsigned long domain_syncs;
+	unsigned long domain_sync_bytes;
+	unsigned long domain_syncs_skipped;
 	int fillColor;
 	GCPtr pGC;
 	PixmapPtr pSourcePixmap;
-};
 
-typedef struct
-{
-	int hwmem_alloc;
-	int hwmem_global_name;
-	int bits_per_pixel;
-	unsigned long usize;
-} mali_mem_info;
+	/* solid fills queued between maliPrepareSolid and maliDoneSolid */
+	PixmapPtr pSolidPixmap;
+	BoxRec solid_boxes[MALI_SOLID_BATCH_SIZE];
+	int num_solid_boxes;
+	unsigned long solid_rects;
+	unsigned long solid_requests;
+	unsigned long solid_flushes;
+
+	/* overlapping copies */
+	int copy_xdir;
+	int copy_ydir;
+	mali_mem_info *scratch;
+	MaliBltJob scratch_job;
+	unsigned long copies;
+	unsigned long copy_bands;
+	unsigned long copy_bounces;
+
+	/* staged uploads and downloads */
+	mali_mem_info *staging[MALI_STAGING_BUFFERS];
+	MaliBltJob staging_job[MALI_STAGING_BUFFERS];
+	int staging_next;
+	unsigned long uploads;
+	unsigned long upload_bytes;
+	unsigned long downloads;
+	unsigned long download_bytes;
+
+	/* choice between the blitter and the CPU, see maliDispatchCpu */
+	Bool dispatch;
+	MaliCostRec cost;
+	unsigned long dispatch_hw[MALI_COST_NUM_KERNELS];
+	unsigned long dispatch_cpu[MALI_COST_NUM_KERNELS];
+
+	/* request template set up by maliPrepareComposite */
+	struct blt_req composite_req;
+	unsigned long composites;
+
+	unsigned long fallbacks[MALI_NUM_FALLBACKS];
+};
 
 typedef struct
 {
 	Bool isFrameBuffer;
+	Bool in_sysmem;		/* malloc'ed, never touched by the blitter */
 	void *addr;
 	mali_mem_info *mem_info;
 	int bits_per_pixel;
+	MaliBltJob read_job;	/* last blit reading from the pixmap */
+	MaliBltJob write_job;	/* last blit writing to the pixmap */
+	BoxRec cpu_dirty;	/* CPU may have written here since the last clean */
+	BoxRec device_dirty;	/* blitter wrote here since the last invalidate */
+	BoxRec access;		/* limits the next PrepareAccess, see maliSetAccessRegion */
+	Bool exported;		/* name handed out to other devices */
 } PrivPixmap;
 
+void maliPixmapWaitIdle( PixmapPtr pPixmap );
+void maliPixmapDeviceWrote( PixmapPtr pPixmap, const BoxRec *pBox );
+Bool maliPixmapEnsureHwmem( PixmapPtr pPixmap );
+int maliExaPrintStats( char *buf, int size );
+MaliBltPtr maliExaVideoChannel( void );
+void maliExaSetDRI2Swap( Bool swapping );
+int maliExaCopyBoxes( PixmapPtr pSrcPixmap, PixmapPtr pDstPixmap, const BoxRec *pBoxes, int nbox, int dx, int dy );
+
 #endif /* _MALI_EXA_H_ */
@@ -43,6 +43,8 @@
 
 #include "mali_def.h"
 #include "mali_fbdev.h"
+#include "mali_hwmem.h"
+#include "mali_blt.h"
 #include "exa.h"
 
 #define TRACE_ENTER(str) \
@@ -95,6 +97,27 @@ typedef enum {
 	OPTION_DRI2,
 	OPTION_DRI2_PAGE_FLIP,
 	OPTION_DRI2_WAIT_VSYNC,
+	OPTION_DRI2_FLIP_BUFFERS,
+	OPTION_DRI2_BUFFER_CACHE,
+	OPTION_DRI2_BUFFER_CACHE_AGE,
+	OPTION_DRI2_BUFFER_AGE,
+	OPTION_HWMEM_POOL_SIZE,
+	OPTION_SYSMEM_PIXMAP_AREA,
+	OPTION_BLT_THREAD,
+	OPTION_BLT_INFLIGHT,
+	OPTION_BLT_CHANNELS,
+	OPTION_BLT_VIDEO_CHANNEL,
+	OPTION_BLT_PRIO_XV,
+	OPTION_BLT_PRIO_DRI2,
+	OPTION_BLT_PRIO_FILL,
+	OPTION_BLT_PRIO_COPY,
+	OPTION_BLT_PRIO_UPLOAD,
+	OPTION_ADAPTIVE_DISPATCH,
+	OPTION_DISPATCH_PROFILE,
+	OPTION_TRACE,
+	OPTION_TRACE_EVENTS,
+	OPTION_TRACE_FILE,
+	OPTION_STATS_INTERVAL,
 } FBDevOpts;
 
 static const OptionInfoRec MaliOptions[] = {
@@ -102,9 +125,42 @@ static const OptionInfoRec MaliOptions[] = {
 	{ OPTION_DRI2,             "DRI2",            OPTV_BOOLEAN, {0}, TRUE  },
 	{ OPTION_DRI2_PAGE_FLIP,   "DRI2_PAGE_FLIP",  OPTV_BOOLEAN, {0}, FALSE },
 	{ OPTION_DRI2_WAIT_VSYNC,  "DRI2_WAIT_VSYNC", OPTV_BOOLEAN, {0}, FALSE },
+	{ OPTION_DRI2_FLIP_BUFFERS, "DRI2_FLIP_BUFFERS", OPTV_INTEGER, {0}, FALSE },
+	{ OPTION_DRI2_BUFFER_CACHE, "DRI2_BUFFER_CACHE", OPTV_INTEGER, {0}, FALSE },
+	{ OPTION_DRI2_BUFFER_CACHE_AGE, "DRI2_BUFFER_CACHE_AGE", OPTV_INTEGER, {0}, FALSE },
+	{ OPTION_DRI2_BUFFER_AGE,  "DRI2_BUFFER_AGE", OPTV_BOOLEAN, {0}, FALSE },
+	{ OPTION_HWMEM_POOL_SIZE,  "HWMEM_POOL_SIZE", OPTV_INTEGER, {0}, FALSE },
+	{ OPTION_SYSMEM_PIXMAP_AREA, "SYSMEM_PIXMAP_AREA", OPTV_INTEGER, {0}, FALSE },
+	{ OPTION_BLT_THREAD,       "BLT_THREAD",      OPTV_BOOLEAN, {0}, FALSE },
+	{ OPTION_BLT_INFLIGHT,     "BLT_INFLIGHT",    OPTV_INTEGER, {0}, FALSE },
+	{ OPTION_BLT_CHANNELS,     "BLT_CHANNELS",    OPTV_INTEGER, {0}, FALSE },
+	{ OPTION_BLT_VIDEO_CHANNEL, "BLT_VIDEO_CHANNEL", OPTV_BOOLEAN, {0}, FALSE },
+	{ OPTION_BLT_PRIO_XV,      "BLT_PRIO_XV",     OPTV_INTEGER, {0}, FALSE },
+	{ OPTION_BLT_PRIO_DRI2,    "BLT_PRIO_DRI2",   OPTV_INTEGER, {0}, FALSE },
+	{ OPTION_BLT_PRIO_FILL,    "BLT_PRIO_FILL",   OPTV_INTEGER, {0}, FALSE },
+	{ OPTION_BLT_PRIO_COPY,    "BLT_PRIO_COPY",   OPTV_INTEGER, {0}, FALSE },
+	{ OPTION_BLT_PRIO_UPLOAD,  "BLT_PRIO_UPLOAD", OPTV_INTEGER, {0}, FALSE },
+	{ OPTION_ADAPTIVE_DISPATCH, "ADAPTIVE_DISPATCH", OPTV_BOOLEAN, {0}, FALSE },
+	{ OPTION_DISPATCH_PROFILE, "DISPATCH_PROFILE", OPTV_STRING,  {0}, FALSE },
+	{ OPTION_TRACE,            "TRACE",           OPTV_BOOLEAN, {0}, FALSE },
+	{ OPTION_TRACE_EVENTS,     "TRACE_EVENTS",    OPTV_INTEGER, {0}, FALSE },
+	{ OPTION_TRACE_FILE,       "TRACE_FILE",      OPTV_STRING,  {0}, FALSE },
+	{ OPTION_STATS_INTERVAL,   "STATS_INTERVAL",  OPTV_INTEGER, {0}, FALSE },
 	{ -1,                      NULL,	             OPTV_NONE,    {0}, FALSE }
 };
 
+/* Priority option and default of every MaliBltClass, in class order */
+static const struct {
+	int option;
+	int def;
+} blt_prio_options[MALI_BLT_NUM_CLASSES] = {
+	{ OPTION_BLT_PRIO_XV,     MALI_BLT_PRIO_XV_DEFAULT },
+	{ OPTION_BLT_PRIO_DRI2,   MALI_BLT_PRIO_DRI2_DEFAULT },
+	{ OPTION_BLT_PRIO_FILL,   MALI_BLT_PRIO_FILL_DEFAULT },
+	{ OPTION_BLT_PRIO_COPY,   MALI_BLT_PRIO_COPY_DEFAULT },
+	{ OPTION_BLT_PRIO_UPLOAD, MALI_BLT_PRIO_UPLOAD_DEFAULT },
+};
+
 
 #ifdef XFree86LOADER
 
@@ -253,6 +309,35 @@ static void mali_check_dri_options( ScrnInfoPtr pScrn )
 		xf86DrvMsg( pScrn->scrnIndex, X_CONFIG, "DRI Fullscreen page flip VSYNC disabled\n");
 	}
 
+	fPtr->flip_buffers = MALI_DRI2_FLIP_BUFFERS_DEFAULT;
+	if ( xf86GetOptValInteger(fPtr->Options, OPTION_DRI2_FLIP_BUFFERS, &fPtr->flip_buffers ) )
+	{
+		if ( fPtr->flip_buffers < 2 ) fPtr->flip_buffers = 2;
+		if ( fPtr->flip_buffers > MALI_DRI2_FLIP_BUFFERS_MAX ) fPtr->flip_buffers = MALI_DRI2_FLIP_BUFFERS_MAX;
+		xf86DrvMsg( pScrn->scrnIndex, X_CONFIG, "DRI Fullscreen page flip between %i buffers\n", fPtr->flip_buffers);
+	}
+
+	fPtr->dri2_cache_size = MALI_DRI2_BUFFER_CACHE_DEFAULT;
+	if ( xf86GetOptValInteger(fPtr->Options, OPTION_DRI2_BUFFER_CACHE, &fPtr->dri2_cache_size ) )
+	{
+		if ( fPtr->dri2_cache_size < 0 ) fPtr->dri2_cache_size = 0;
+		if ( fPtr->dri2_cache_size > MALI_DRI2_BUFFER_CACHE_MAX ) fPtr->dri2_cache_size = MALI_DRI2_BUFFER_CACHE_MAX;
+		xf86DrvMsg( pScrn->scrnIndex, X_CONFIG, "Up to %i released DRI2 buffers kept for reuse\n", fPtr->dri2_cache_size);
+	}
+
+	fPtr->dri2_cache_age = MALI_DRI2_BUFFER_CACHE_AGE_DEFAULT;
+	if ( xf86GetOptValInteger(fPtr->Options, OPTION_DRI2_BUFFER_CACHE_AGE, &fPtr->dri2_cache_age ) )
+	{
+		if ( fPtr->dri2_cache_age < 1 ) fPtr->dri2_cache_age = 1;
+		xf86DrvMsg( pScrn->scrnIndex, X_CONFIG, "Released DRI2 buffers kept for %i ms\n", fPtr->dri2_cache_age);
+	}
+
+	fPtr->dri2_buffer_age = xf86ReturnOptValBool(fPtr->Options, OPTION_DRI2_BUFFER_AGE, FALSE);
+	if ( fPtr->dri2_buffer_age )
+	{
+		xf86DrvMsg( pScrn->scrnIndex, X_CONFIG, "DRI2 buffer age passed to clients in the buffer flags\n");
+	}
+
 	if ( pScrn->depth != 16 && pScrn->depth != 24 )
 	{
 		xf86DrvMsg( pScrn->scrnIndex, X_CONFIG, "DRI is disabled since display does not run at 16bpp or 24bpp\n" );
@@ -263,10 +348,73 @@ static void mali_check_dri_options( ScrnInfoPtr pScrn )
 static void mali_check_exa_options( ScrnInfoPtr pScrn )
 {
 	MaliPtr fPtr = MALIPTR(pScrn);
-
-	IGNORE(fPtr);
+	int pool_size = MALI_HWMEM_POOL_SIZE_DEFAULT;
+	int i;
 
 	/* EXA specific options checked here */
+	if ( xf86GetOptValInteger(fPtr->Options, OPTION_HWMEM_POOL_SIZE, &pool_size ) )
+	{
+		xf86DrvMsg( pScrn->scrnIndex, X_CONFIG, "hwmem pixmap pool limited to %i kB\n", pool_size);
+	}
+	if ( pool_size < 0 ) pool_size = 0;
+	fPtr->hwmem_pool_size = (unsigned long)pool_size * 1024;
+
+	fPtr->sysmem_pixmap_area = MALI_SYSMEM_PIXMAP_AREA_DEFAULT;
+	if ( xf86GetOptValInteger(fPtr->Options, OPTION_SYSMEM_PIXMAP_AREA, &fPtr->sysmem_pixmap_area ) )
+	{
+		xf86DrvMsg( pScrn->scrnIndex, X_CONFIG, "Pixmaps up to %i pixels kept in system memory\n", fPtr->sysmem_pixmap_area);
+	}
+
+	fPtr->blt_thread = xf86ReturnOptValBool(fPtr->Options, OPTION_BLT_THREAD, TRUE);
+	if ( !fPtr->blt_thread )
+	{
+		xf86DrvMsg( pScrn->scrnIndex, X_CONFIG, "Blits submitted from the server thread\n");
+	}
+
+	fPtr->blt_inflight = MALI_BLT_MAX_INFLIGHT;
+	if ( xf86GetOptValInteger(fPtr->Options, OPTION_BLT_INFLIGHT, &fPtr->blt_inflight ) )
+	{
+		if ( fPtr->blt_inflight < 1 ) fPtr->blt_inflight = 1;
+		if ( fPtr->blt_inflight > MALI_BLT_MAX_INFLIGHT ) fPtr->blt_inflight = MALI_BLT_MAX_INFLIGHT;
+		xf86DrvMsg( pScrn->scrnIndex, X_CONFIG, "At most %i blits in flight\n", fPtr->blt_inflight);
+	}
+
+	fPtr->blt_channels = MALI_BLT_CHANNELS_DEFAULT;
+	if ( xf86GetOptValInteger(fPtr->Options, OPTION_BLT_CHANNELS, &fPtr->blt_channels ) )
+	{
+		if ( fPtr->blt_channels < 1 ) fPtr->blt_channels = 1;
+		if ( fPtr->blt_channels > MALI_BLT_MAX_CHANNELS ) fPtr->blt_channels = MALI_BLT_MAX_CHANNELS;
+		xf86DrvMsg( pScrn->scrnIndex, X_CONFIG, "%i blitter channels\n", fPtr->blt_channels);
+	}
+
+	fPtr->blt_video_channel = xf86ReturnOptValBool(fPtr->Options, OPTION_BLT_VIDEO_CHANNEL, TRUE);
+	if ( !fPtr->blt_video_channel )
+	{
+		xf86DrvMsg( pScrn->scrnIndex, X_CONFIG, "Video shares the blitter channels with EXA\n");
+	}
+
+	for ( i = 0; i < MALI_BLT_NUM_CLASSES; i++ )
+	{
+		fPtr->blt_prio[i] = blt_prio_options[i].def;
+		if ( xf86GetOptValInteger(fPtr->Options, blt_prio_options[i].option, &fPtr->blt_prio[i] ) )
+		{
+			if ( fPtr->blt_prio[i] < MALI_BLT_PRIO_MIN ) fPtr->blt_prio[i] = MALI_BLT_PRIO_MIN;
+			if ( fPtr->blt_prio[i] > MALI_BLT_PRIO_MAX ) fPtr->blt_prio[i] = MALI_BLT_PRIO_MAX;
+			xf86DrvMsg( pScrn->scrnIndex, X_CONFIG, "Blits of class %s at priority %i\n", maliBltClassName(i), fPtr->blt_prio[i]);
+		}
+	}
+
+	fPtr->dispatch = xf86ReturnOptValBool(fPtr->Options, OPTION_ADAPTIVE_DISPATCH, TRUE);
+	if ( !fPtr->dispatch )
+	{
+		xf86DrvMsg( pScrn->scrnIndex, X_CONFIG, "Fills and copies always blitted\n");
+	}
+
+	fPtr->dispatch_profile = xf86GetOptValString(fPtr->Options, OPTION_DISPATCH_PROFILE);
+	if ( fPtr->dispatch_profile )
+	{
+		xf86DrvMsg( pScrn->scrnIndex, X_CONFIG, "Blitter cost profile kept in %s\n", fPtr->dispatch_profile);
+	}
 }
 
 static void mali_check_misc_options( ScrnInfoPtr pScrn )
@@ -278,6 +426,29 @@ static void mali_check_misc_options( ScrnInfoPtr pScrn )
 		xf86DrvMsg( pScrn->scrnIndex, X_CONFIG, "DEBUG output enabled\n");
 		debug = TRUE;
 	}
+
+	fPtr->trace_events = MALI_TRACE_EVENTS_DEFAULT;
+	if ( xf86GetOptValInteger(fPtr->Options, OPTION_TRACE_EVENTS, &fPtr->trace_events ) )
+	{
+		xf86DrvMsg( pScrn->scrnIndex, X_CONFIG, "Trace ring holds %i events\n", fPtr->trace_events);
+	}
+	if ( fPtr->trace_events < 1 ) fPtr->trace_events = 1;
+
+	fPtr->trace_file = xf86GetOptValString(fPtr->Options, OPTION_TRACE_FILE);
+	if ( !fPtr->trace_file ) fPtr->trace_file = MALI_TRACE_FILE_DEFAULT;
+
+	if ( xf86ReturnOptValBool(fPtr->Options, OPTION_TRACE, FALSE ) )
+	{
+		xf86DrvMsg( pScrn->scrnIndex, X_CONFIG, "Tracing enabled, SIGUSR2 dumps to %s\n", fPtr->trace_file);
+		fPtr->trace_at_start = TRUE;
+	}
+
+	fPtr->stats_interval = MALI_STATS_INTERVAL_DEFAULT;
+	if ( xf86GetOptValInteger(fPtr->Options, OPTION_STATS_INTERVAL, &fPtr->stats_interval ) )
+	{
+		xf86DrvMsg( pScrn->scrnIndex, X_CONFIG, "Statistics refreshed every %i ms\n", fPtr->stats_interval);
+	}
+	if ( fPtr->stats_interval < 0 ) fPtr->stats_interval = 0;
 }
 
 static const xf86CrtcConfigFuncsRec fbdev_crtc_config_funcs = 
@@ -1036,7 +1207,7 @@ static Bool MaliScreenInit(int scrnIndex, ScreenPtr pScreen, int argc, char **ar
 		else xf86DrvMsg(scrnIndex,X_ERROR,"DRI2 initialization failed\n");
 	}
 
-	if (0 == (fPtr->hwmem_fd = open("/dev/hwmem", O_RDWR)))
+	if ((fPtr->hwmem_fd = maliHwmemDevOpen()) < 0)
 	{
 		xf86DrvMsg(scrnIndex,X_ERROR,"opening of hwmem device file failed\n");
 		return FALSE;
@@ -1118,6 +1289,8 @@ static Bool MaliScreenInit(int scrnIndex, ScreenPtr pScreen, int argc, char **ar
 	xf86LoadSubModule(pScrn, "exa");
 	fPtr->exa = exaDriverAlloc();
 
+	maliTraceInit( &fPtr->trace, pScrn->scrnIndex, fPtr->trace_events, fPtr->trace_file, fPtr->trace_at_start );
+
 	if ( maliSetupExa( pScreen, fPtr->exa, pScrn->virtualX, pScrn->virtualY, fPtr->fbmem ) )
 	{
 		xf86DrvMsg(pScrn->scrnIndex, X_WARNING, "Initializing EXA Driver!\n");
@@ -1160,6 +1333,8 @@ static Bool MaliScreenInit(int scrnIndex, ScreenPtr pScreen, int argc, char **ar
 
 	pScreen->SaveScreen = MaliHWSaveScreenWeak();
 
+	maliStatsInit( &fPtr->stats, pScreen, fPtr->stats_interval );
+
 	/* Wrap the current CloseScreen function */
 	fPtr->CloseScreen = pScreen->CloseScreen;
 	pScreen->CloseScreen = MaliCloseScreen;
@@ -1204,11 +1379,23 @@ static Bool MaliCloseScreen(int scrnIndex, ScreenPtr pScreen)
 
 	pScrn->vtSema = FALSE;
 
+	/* cached DRI2 buffers are pixmaps of EXA, which goes with the screen */
+	if ( fPtr->dri_open && fPtr->dri_render == DRI_2 ) MaliDRI2FlushBufferCache( pScreen );
+
 	pScreen->CreateScreenResources = fPtr->CreateScreenResources;
 	pScreen->CloseScreen = fPtr->CloseScreen;
 
 	(*pScreen->CloseScreen)(scrnIndex, pScreen);
 
+	maliStatsFini( &fPtr->stats );
+
+	if ( fPtr->exa )
+	{
+		maliCloseExa( pScreen );
+	}
+
+	maliTraceFini( &fPtr->trace );
+
 	if ( fPtr->dri_open && fPtr->dri_render == DRI_2 )
 	{
 		fPtr->dri_open = FALSE;
@@ -1218,7 +1405,7 @@ static Bool MaliCloseScreen(int scrnIndex, ScreenPtr pScreen)
 
 	if ( fPtr->hwmem_fd )
 	{
-		close(fPtr->hwmem_fd);
+		maliHwmemDevClose(fPtr->hwmem_fd);
 		fPtr->hwmem_fd = 0;
 	}
 
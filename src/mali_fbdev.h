@@ -30,12 +30,34 @@
 #include "exa.h"
 #include <xf86xv.h>
 #include <video/mcde_fb.h>
+#include "mali_trace.h"
+#include "mali_stats.h"
+#include "mali_blt.h"
+#include "mali_vblank.h"
 
 #define DPMSModeOn	0
 #define DPMSModeStandby	1
 #define DPMSModeSuspend	2
 #define DPMSModeOff	3
 
+/* Slices of the virtual framebuffer DRI2 flips between, as far as yres_virtual allows */
+#define MALI_DRI2_FLIP_BUFFERS_DEFAULT 3
+#define MALI_DRI2_FLIP_BUFFERS_MAX 4
+
+/* Released DRI2 buffer pixmaps kept for reuse by default, at most, and for how many ms */
+#define MALI_DRI2_BUFFER_CACHE_DEFAULT 4
+#define MALI_DRI2_BUFFER_CACHE_MAX 8
+#define MALI_DRI2_BUFFER_CACHE_AGE_DEFAULT 2000
+
+/* A released back or fake front buffer pixmap, for a buffer of the same drawable, size and format */
+typedef struct
+{
+	PixmapPtr pPixmap;
+	XID drawable;
+	unsigned int format;
+	CARD32 released;
+} MaliDRI2CachedBufferRec;
+
 enum dri_type
 {
 	DRI_DISABLED,
@@ -63,7 +85,49 @@ typedef struct {
 	char deviceName[64];
 	Bool use_pageflipping;
 	Bool use_pageflipping_vsync;
+	int  flip_buffers;
+	int  flip_slices;
+	int  flip_scanout;
+	int  flip_queued;
+	int  flip_back;
+	CARD64 flip_msc;
+	unsigned int *flip_back_flags;
+	unsigned int *flip_back_age;
+	CARD32 flip_frame;
+	CARD32 flip_slice_frame[MALI_DRI2_FLIP_BUFFERS_MAX];
+	Bool dri2_buffer_age;
+	MaliVblankRec vblank;
+	struct _MaliDRI2Swap *swaps;
+	unsigned long dri2_flips;
+	unsigned long dri2_blits;
+	unsigned long dri2_msc_waits;
+	unsigned long dri2_copies;
+	unsigned long dri2_copy_pixels;
+	int  dri2_cache_size;
+	int  dri2_cache_age;
+	int  dri2_cached;
+	MaliDRI2CachedBufferRec dri2_cache[MALI_DRI2_BUFFER_CACHE_MAX];
+	OsTimerPtr dri2_cache_timer;
+	unsigned long dri2_cache_hits;
+	unsigned long dri2_cache_misses;
 	int  hwmem_fd;
+	unsigned long hwmem_pool_size;
+	int  sysmem_pixmap_area;
+	Bool blt_thread;
+	int  blt_inflight;
+	int  blt_channels;
+	Bool blt_video_channel;
+	int  blt_prio[MALI_BLT_NUM_CLASSES];
+	Bool dispatch;
+	const char *dispatch_profile;
+	Bool trace_at_start;
+	int  trace_events;
+	const char *trace_file;
+	MaliTraceRec trace;
+	int  stats_interval;
+	MaliStatsRec stats;
+	unsigned long xv_frames;
+	unsigned long xv_buffer_allocs;
         /* Video Adaptors */
         XF86VideoAdaptorPtr overlay_adaptor;
         XF86VideoAdaptorPtr textured_adaptor;
@@ -95,10 +159,17 @@ typedef struct {
 #define MALIDBGMSG(type, format, args...)
 #endif
 
+/* Default amount of idle pixmap memory kept by the hwmem pool, in kB */
+#define MALI_HWMEM_POOL_SIZE_DEFAULT 8192
+
+/* Default size in pixels up to which pixmaps are kept in system memory */
+#define MALI_SYSMEM_PIXMAP_AREA_DEFAULT 1024
+
 Bool FBDEV_lcd_init(ScrnInfoPtr pScrn);
 
 Bool MaliDRI2ScreenInit( ScreenPtr pScreen );
 void MaliDRI2CloseScreen( ScreenPtr pScreen );
+void MaliDRI2FlushBufferCache( ScreenPtr pScreen );
 
 #define VIDEO_IMAGE_MAX_WIDTH 1920
 #define VIDEO_IMAGE_MAX_HEIGHT 1280
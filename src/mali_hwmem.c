@@ -0,0 +1,274 @@
+/*
+ * Copyright (C) ST-Ericsson SA 2011
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+/*
+ * hwmem buffer allocation for pixmaps.
+ *
+ * Allocating and exporting contiguous hwmem is expensive and fragments the
+ * contiguous memory area, while toolkits create and destroy small pixmaps
+ * all the time. Released buffers are therefore kept on per size class free
+ * lists, exported and mapped, and handed out again for the next pixmap of
+ * that class. The classes are four per power of two, so at most a fifth of
+ * a pooled buffer is wasted. The pool keeps at most budget bytes of idle
+ * buffers; anything beyond that is released to hwmem straight away.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <linux/hwmem.h>
+
+#include "mali_hwmem.h"
+
+#define MALI_HWMEM_PAGE_SIZE 4096
+
+#ifndef MALI_BLT_EMULATION
+/*
+ * Device access. Everything in the driver goes through these, so that an
+ * emulation build (src/emu) can stand in for /dev/hwmem.
+ */
+int maliHwmemDevOpen( void )
+{
+	return open("/dev/hwmem", O_RDWR);
+}
+
+void maliHwmemDevClose( int fd )
+{
+	close(fd);
+}
+
+int maliHwmemDevIoctl( int fd, unsigned long request, unsigned long arg )
+{
+	return ioctl(fd, request, arg);
+}
+
+void *maliHwmemDevMmap( int fd, int alloc, unsigned long size )
+{
+	return mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, (off_t)alloc);
+}
+
+void maliHwmemDevMunmap( void *addr, unsigned long size )
+{
+	munmap(addr, size);
+}
+#endif /* MALI_BLT_EMULATION */
+
+mali_mem_info *maliHwmemAlloc( int fd, unsigned long size, unsigned int flags )
+{
+	struct hwmem_alloc_request args;
+	mali_mem_info *mem_info;
+
+	mem_info = calloc(1, sizeof(*mem_info));
+	if (!mem_info)
+		return NULL;
+
+	args.size = size;
+	args.flags = flags;
+	args.default_access = HWMEM_ACCESS_READ | HWMEM_ACCESS_WRITE | HWMEM_ACCESS_IMPORT;
+	args.mem_type = HWMEM_MEM_CONTIGUOUS_SYS;
+	mem_info->hwmem_alloc = maliHwmemDevIoctl(fd, HWMEM_ALLOC_IOC, (unsigned long)&args);
+	if (mem_info->hwmem_alloc <= 0)
+	{
+		ErrorF("mali: failed to allocate hwmem memory (%lu bytes)\n", size);
+		free(mem_info);
+		return NULL;
+	}
+
+	mem_info->hwmem_global_name = maliHwmemDevIoctl(fd, HWMEM_EXPORT_IOC, mem_info->hwmem_alloc);
+	if (mem_info->hwmem_global_name <= 0)
+	{
+		ErrorF("mali: failed to export global hwmem name\n");
+		maliHwmemDevIoctl(fd, HWMEM_RELEASE_IOC, mem_info->hwmem_alloc);
+		free(mem_info);
+		return NULL;
+	}
+
+	mem_info->alloc_size = size;
+	mem_info->usize = size;
+
+	return mem_info;
+}
+
+void maliHwmemRelease( int fd, mali_mem_info *mem_info )
+{
+	if (mem_info->addr)
+		maliHwmemDevMunmap(mem_info->addr, mem_info->alloc_size);
+
+	maliHwmemDevIoctl(fd, HWMEM_RELEASE_IOC, mem_info->hwmem_alloc);
+	free(mem_info);
+}
+
+void *maliHwmemMap( int fd, mali_mem_info *mem_info )
+{
+	void *addr;
+
+	if (mem_info->addr)
+		return mem_info->addr;
+
+	addr = maliHwmemDevMmap(fd, mem_info->hwmem_alloc, mem_info->alloc_size);
+	if (addr == MAP_FAILED)
+		return NULL;
+
+	mem_info->addr = addr;
+
+	return addr;
+}
+
+void maliHwmemPoolInit( MaliHwmemPoolPtr pool, int fd, unsigned long budget )
+{
+	unsigned long pages;
+	int i;
+
+	memset(pool, 0, sizeof(*pool));
+	pool->fd = fd;
+	pool->budget = budget;
+
+	/* 1, 2, 3 pages, then 4, 5, 6, 7, 8, 10, 12, 14, 16, 20, ... pages */
+	for (i = 0; i < MALI_HWMEM_POOL_CLASSES; i++)
+	{
+		if (i < 3)
+			pages = i + 1;
+		else
+			pages = (4UL << ((i - 3) / 4)) * (4 + (i - 3) % 4) / 4;
+
+		pool->class_size[i] = pages * MALI_HWMEM_PAGE_SIZE;
+	}
+}
+
+void maliHwmemPoolFini( MaliHwmemPoolPtr pool )
+{
+	mali_mem_info *mem_info;
+	int i;
+
+	for (i = 0; i < MALI_HWMEM_POOL_CLASSES; i++)
+	{
+		while ((mem_info = pool->free_list[i]))
+		{
+			pool->free_list[i] = mem_info->next;
+			maliHwmemRelease(pool->fd, mem_info);
+		}
+	}
+
+	pool->cached_bytes = 0;
+}
+
+static int maliHwmemPoolClass( MaliHwmemPoolPtr pool, unsigned long size )
+{
+	int i;
+
+	for (i = 0; i < MALI_HWMEM_POOL_CLASSES; i++)
+	{
+		if (size <= pool->class_size[i])
+			return i;
+	}
+
+	return -1;
+}
+
+/* Size actually allocated for a request of size bytes */
+unsigned long maliHwmemPoolClassSize( MaliHwmemPoolPtr pool, unsigned long size )
+{
+	int class = maliHwmemPoolClass(pool, size);
+
+	return class < 0 ? size : pool->class_size[class];
+}
+
+static void maliHwmemPoolAccount( MaliHwmemPoolPtr pool, unsigned long size )
+{
+	pool->live_bytes += size;
+	if (pool->live_bytes > pool->peak_bytes)
+		pool->peak_bytes = pool->live_bytes;
+}
+
+mali_mem_info *maliHwmemPoolAlloc( MaliHwmemPoolPtr pool, unsigned long size )
+{
+	int class = maliHwmemPoolClass(pool, size);
+	mali_mem_info *mem_info;
+
+	if (class >= 0 && pool->free_list[class])
+	{
+		mem_info = pool->free_list[class];
+		pool->free_list[class] = mem_info->next;
+		pool->cached_bytes -= mem_info->alloc_size;
+		pool->hits++;
+
+		mem_info->next = NULL;
+		mem_info->usize = size;
+		maliHwmemPoolAccount(pool, mem_info->alloc_size);
+
+		MALI_TRACE_INSTANT(pool->trace, MALI_TRACE_HWMEM_ALLOC, mem_info->alloc_size, 1);
+
+		return mem_info;
+	}
+
+	pool->misses++;
+
+	mem_info = maliHwmemAlloc(pool->fd, maliHwmemPoolClassSize(pool, size), HWMEM_ALLOC_HINT_CACHED);
+	if (mem_info)
+	{
+		mem_info->usize = size;
+		maliHwmemPoolAccount(pool, mem_info->alloc_size);
+		MALI_TRACE_INSTANT(pool->trace, MALI_TRACE_HWMEM_ALLOC, mem_info->alloc_size, 0);
+	}
+
+	return mem_info;
+}
+
+void maliHwmemPoolFree( MaliHwmemPoolPtr pool, mali_mem_info *mem_info )
+{
+	int class = maliHwmemPoolClass(pool, mem_info->alloc_size);
+
+	if (class >= 0 && pool->class_size[class] == mem_info->alloc_size &&
+	    pool->cached_bytes + mem_info->alloc_size <= pool->budget)
+	{
+		pool->live_bytes -= mem_info->alloc_size;
+		mem_info->next = pool->free_list[class];
+		pool->free_list[class] = mem_info;
+		pool->cached_bytes += mem_info->alloc_size;
+		MALI_TRACE_INSTANT(pool->trace, MALI_TRACE_HWMEM_FREE, mem_info->alloc_size, 1);
+		return;
+	}
+
+	maliHwmemPoolRelease(pool, mem_info);
+}
+
+/*
+ * Release a buffer of the pool without keeping it, for buffers whose name
+ * went to clients: they may still have it imported, and the next pixmap
+ * given the buffer would share its memory with them.
+ */
+void maliHwmemPoolRelease( MaliHwmemPoolPtr pool, mali_mem_info *mem_info )
+{
+	pool->live_bytes -= mem_info->alloc_size;
+
+	MALI_TRACE_INSTANT(pool->trace, MALI_TRACE_HWMEM_FREE, mem_info->alloc_size, 0);
+	pool->releases++;
+	maliHwmemRelease(pool->fd, mem_info);
+}
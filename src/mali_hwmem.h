@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) ST-Ericsson SA 2011
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#ifndef _MALI_HWMEM_H_
+#define _MALI_HWMEM_H_
+
+#include "xf86.h"
+#include "mali_trace.h"
+
+typedef struct _mali_mem_info
+{
+	int hwmem_alloc;
+	int hwmem_global_name;
+	int bits_per_pixel;
+	unsigned long usize;
+	unsigned long alloc_size;
+	void *addr;
+	struct _mali_mem_info *next;
+} mali_mem_info;
+
+/* Number of pooled size classes, the largest one holds 14 MiB */
+#define MALI_HWMEM_POOL_CLASSES 43
+
+typedef struct
+{
+	int fd;
+	unsigned long budget;
+	unsigned long cached_bytes;
+	unsigned long class_size[MALI_HWMEM_POOL_CLASSES];
+	mali_mem_info *free_list[MALI_HWMEM_POOL_CLASSES];
+	unsigned long hits;
+	unsigned long misses;
+	unsigned long releases;
+	unsigned long live_bytes;	/* handed out and not yet freed */
+	unsigned long peak_bytes;
+	MaliTracePtr trace;
+} MaliHwmemPoolRec, *MaliHwmemPoolPtr;
+
+int maliHwmemDevOpen( void );
+void maliHwmemDevClose( int fd );
+int maliHwmemDevIoctl( int fd, unsigned long request, unsigned long arg );
+void *maliHwmemDevMmap( int fd, int alloc, unsigned long size );
+void maliHwmemDevMunmap( void *addr, unsigned long size );
+
+mali_mem_info *maliHwmemAlloc( int fd, unsigned long size, unsigned int flags );
+void maliHwmemRelease( int fd, mali_mem_info *mem_info );
+void *maliHwmemMap( int fd, mali_mem_info *mem_info );
+
+void maliHwmemPoolInit( MaliHwmemPoolPtr pool, int fd, unsigned long budget );
+void maliHwmemPoolFini( MaliHwmemPoolPtr pool );
+unsigned long maliHwmemPoolClassSize( MaliHwmemPoolPtr pool, unsigned long size );
+mali_mem_info *maliHwmemPoolAlloc( MaliHwmemPoolPtr pool, unsigned long size );
+void maliHwmemPoolFree( MaliHwmemPoolPtr pool, mali_mem_info *mem_info );
+void maliHwmemPoolRelease( MaliHwmemPoolPtr pool, mali_mem_info *mem_info );
+
+#endif /* _MALI_HWMEM_H_ */
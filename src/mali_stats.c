@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) ST-Ericsson SA 2011
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Acceleration statistics.
+ *
+ * The counters of the EXA code, the blitter, the hwmem pool and Xv are
+ * published as the _MALI_STATS property of the root window, one
+ * "name=value" line per counter, and refreshed from a server timer:
+ *
+ *   xprop -root -notype _MALI_STATS
+ *
+ * All counters are totals since the server started.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <X11/Xatom.h>
+
+#include "dixstruct.h"
+#include "windowstr.h"
+#include "property.h"
+#include "mali_fbdev.h"
+#include "mali_exa.h"
+#include "mali_stats.h"
+
+static WindowPtr maliStatsRoot( ScreenPtr pScreen )
+{
+#if GET_ABI_MAJOR(ABI_VIDEODRV_VERSION) >= 9
+	return pScreen->root;
+#else
+	return WindowTable[pScreen->myNum];
+#endif
+}
+
+static void maliStatsUpdate( MaliStatsPtr stats )
+{
+	ScrnInfoPtr pScrn = xf86Screens[stats->pScreen->myNum];
+	MaliPtr fPtr = MALIPTR(pScrn);
+	WindowPtr pRoot = maliStatsRoot(stats->pScreen);
+	int len;
+
+	/* the root window only exists once the screen is up */
+	if (!pRoot)
+		return;
+
+	len = maliExaPrintStats(stats->text, sizeof(stats->text));
+	if (len < (int)sizeof(stats->text))
+		len += snprintf(stats->text + len, sizeof(stats->text) - len,
+				"xv_frames=%lu\nxv_buffer_allocs=%lu\n"
+				"dri2_flips=%lu\ndri2_blits=%lu\ndri2_msc_waits=%lu\ndri2_vblanks=%lu\n"
+				"dri2_copies=%lu\ndri2_copy_px=%lu\ndri2_copy_px_per_swap=%lu\n"
+				"dri2_cache_hits=%lu\ndri2_cache_misses=%lu\ndri2_cached=%d\n",
+				fPtr->xv_frames, fPtr->xv_buffer_allocs,
+				fPtr->dri2_flips, fPtr->dri2_blits, fPtr->dri2_msc_waits, fPtr->vblank.events,
+				fPtr->dri2_copies, fPtr->dri2_copy_pixels,
+				fPtr->dri2_copies ? fPtr->dri2_copy_pixels / fPtr->dri2_copies : 0,
+				fPtr->dri2_cache_hits, fPtr->dri2_cache_misses, fPtr->dri2_cached);
+	if (len >= (int)sizeof(stats->text))
+		len = sizeof(stats->text) - 1;
+
+	dixChangeWindowProperty(serverClient, pRoot, stats->property, XA_STRING, 8,
+				PropModeReplace, len, stats->text, TRUE);
+}
+
+static CARD32 maliStatsTimer( OsTimerPtr timer, CARD32 now, pointer arg )
+{
+	MaliStatsPtr stats = arg;
+
+	maliStatsUpdate(stats);
+
+	return stats->interval;
+}
+
+Bool maliStatsInit( MaliStatsPtr stats, ScreenPtr pScreen, CARD32 interval )
+{
+	memset(stats, 0, sizeof(*stats));
+
+	if (!interval)
+		return TRUE;
+
+	stats->pScreen = pScreen;
+	stats->interval = interval;
+	stats->property = MakeAtom(MALI_STATS_PROPERTY, strlen(MALI_STATS_PROPERTY), TRUE);
+	stats->timer = TimerSet(NULL, 0, interval, maliStatsTimer, stats);
+	if (!stats->timer)
+	{
+		xf86DrvMsg(xf86Screens[pScreen->myNum]->scrnIndex, X_ERROR, "[%s:%d] failed to set up the statistics timer\n", __FUNCTION__, __LINE__);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+void maliStatsFini( MaliStatsPtr stats )
+{
+	if (!stats->timer)
+		return;
+
+	TimerFree(stats->timer);
+	stats->timer = NULL;
+}
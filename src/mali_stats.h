@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) ST-Ericsson SA 2011
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef _MALI_STATS_H_
+#define _MALI_STATS_H_
+
+#include "xf86.h"
+
+/* Root window property holding the counters as "name=value" lines */
+#define MALI_STATS_PROPERTY "_MALI_STATS"
+
+/* Refresh period of the property in ms */
+#define MALI_STATS_INTERVAL_DEFAULT 5000
+
+#define MALI_STATS_SIZE 4096
+
+typedef struct
+{
+	ScreenPtr pScreen;
+	OsTimerPtr timer;
+	Atom property;
+	CARD32 interval;
+	char text[MALI_STATS_SIZE];
+} MaliStatsRec, *MaliStatsPtr;
+
+Bool maliStatsInit( MaliStatsPtr stats, ScreenPtr pScreen, CARD32 interval );
+void maliStatsFini( MaliStatsPtr stats );
+
+#endif /* _MALI_STATS_H_ */
@@ -0,0 +1,278 @@
+/*
+ * Copyright (C) ST-Ericsson SA 2011
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Event tracing.
+ *
+ * Events go into a fixed ring that keeps the most recent ones, see
+ * MaliTraceRec. SIGUSR2 toggles recording: it starts a fresh capture when
+ * recording is off and stops and dumps it when on. The signal handler only
+ * counts, the toggle happens in the block handler of every screen. A screen
+ * closed while recording dumps its capture as well.
+ *
+ * Dumps are Chrome trace event JSON, for chrome://tracing or Perfetto.
+ * Blits are async events from submission until the driver sees them
+ * retired, which is at the next wait covering them rather than the moment
+ * the hardware finished.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "mali_trace.h"
+
+typedef struct
+{
+	const char *name;
+	const char *cat;
+	char phase;
+	const char *arg0;
+	const char *arg1;
+} MaliTraceEventInfo;
+
+static const MaliTraceEventInfo maliTraceEvents[MALI_TRACE_NUM_EVENTS] = {
+	{ "blit", "blt", 'b', "job", "pixels" },
+	{ "blit wait", "blt", 'X', "job", NULL },
+	{ "blit", "blt", 'e', "job", NULL },
+	{ "hwmem alloc", "hwmem", 'i', "size", "pooled" },
+	{ "hwmem free", "hwmem", 'i', "size", "pooled" },
+	{ "domain sync", "hwmem", 'X', "bytes", "to_cpu" },
+	{ "dri2 swap", "dri2", 'X', "pixels", NULL },
+	{ "dri2 flip", "dri2", 'X', "yoffset", NULL },
+	{ "xv frame", "xv", 'X', "fourcc", "pixels" },
+	{ "vblank", "dri2", 'i', "msc", "pending" }
+};
+
+static volatile sig_atomic_t maliTraceSignals;
+static OsSigHandlerPtr maliTraceOldSignal;
+static int maliTraceUsers;
+
+static void maliTraceSignal( int sig )
+{
+	maliTraceSignals++;
+}
+
+static void maliTraceBlockHandler( pointer data, OSTimePtr pTimeout, pointer pReadmask )
+{
+	MaliTracePtr trace = data;
+	unsigned int signals = maliTraceSignals;
+
+	if (signals == trace->signals)
+		return;
+
+	trace->signals = signals;
+
+	if (trace->enabled)
+	{
+		maliTraceDisable(trace);
+		maliTraceDump(trace);
+	}
+	else
+		maliTraceEnable(trace);
+}
+
+static void maliTraceWakeupHandler( pointer data, int result, pointer pReadmask )
+{
+}
+
+CARD64 maliTraceNow( void )
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (CARD64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void maliTraceRecord( MaliTracePtr trace, MaliTraceEvent event, CARD64 start, CARD32 arg0, CARD32 arg1 )
+{
+	CARD64 now = maliTraceNow();
+	MaliTraceRecord *record = &trace->records[__sync_fetch_and_add(&trace->head, 1) & trace->mask];
+
+	record->timestamp = start ? start : now;
+	record->duration = start ? now - start : 0;
+	record->event = event;
+	record->arg0 = arg0;
+	record->arg1 = arg1;
+}
+
+/* Start a fresh capture, allocating the ring on first use */
+Bool maliTraceEnable( MaliTracePtr trace )
+{
+	if (!trace->records)
+	{
+		unsigned int size = 1;
+
+		while (size < trace->size)
+			size <<= 1;
+
+		trace->records = calloc(size, sizeof(MaliTraceRecord));
+		if (!trace->records)
+		{
+			xf86DrvMsg(trace->scrnIndex, X_ERROR, "[%s:%d] failed to allocate %u trace events\n", __FUNCTION__, __LINE__, size);
+			return FALSE;
+		}
+		trace->mask = size - 1;
+	}
+
+	trace->head = 0;
+	__sync_synchronize();
+	trace->enabled = TRUE;
+
+	xf86DrvMsg(trace->scrnIndex, X_INFO, "Tracing started, keeping the last %u events\n", trace->mask + 1);
+
+	return TRUE;
+}
+
+void maliTraceDisable( MaliTracePtr trace )
+{
+	trace->enabled = FALSE;
+	__sync_synchronize();
+}
+
+Bool maliTraceDump( MaliTracePtr trace )
+{
+	unsigned int head = trace->head;
+	unsigned int count, i;
+	int pid = getpid();
+	FILE *f;
+	int fd;
+
+	if (!trace->records || !head)
+		return FALSE;
+
+	/*
+	 * The server runs as root, never write through a link someone else
+	 * put in place of the file: the old dump goes and a new file is made.
+	 */
+	unlink(trace->file);
+	fd = open(trace->file, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW, 0600);
+	f = fd >= 0 ? fdopen(fd, "w") : NULL;
+	if (!f)
+	{
+		xf86DrvMsg(trace->scrnIndex, X_ERROR, "[%s:%d] failed to open trace file %s\n", __FUNCTION__, __LINE__, trace->file);
+		if (fd >= 0)
+			close(fd);
+		return FALSE;
+	}
+
+	count = head > trace->mask ? trace->mask + 1 : head;
+
+	fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+	for (i = head - count; i != head; i++)
+	{
+		const MaliTraceRecord *record = &trace->records[i & trace->mask];
+		const MaliTraceEventInfo *info;
+
+		if (record->event >= MALI_TRACE_NUM_EVENTS)
+			continue;
+		info = &maliTraceEvents[record->event];
+
+		fprintf(f, "{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"%c\",\"pid\":%d,\"tid\":%d,\"ts\":%llu.%03u",
+			info->name, info->cat, info->phase, pid, trace->scrnIndex,
+			(unsigned long long)(record->timestamp / 1000), (unsigned int)(record->timestamp % 1000));
+
+		switch (info->phase)
+		{
+			case 'X':
+				fprintf(f, ",\"dur\":%u.%03u", record->duration / 1000, record->duration % 1000);
+				break;
+			case 'b':
+			case 'e':
+				fprintf(f, ",\"id\":\"0x%x\"", record->arg0);
+				break;
+			case 'i':
+				fprintf(f, ",\"s\":\"t\"");
+				break;
+		}
+
+		fprintf(f, ",\"args\":{\"%s\":%u", info->arg0, record->arg0);
+		if (info->arg1)
+			fprintf(f, ",\"%s\":%u", info->arg1, record->arg1);
+		fprintf(f, "}}%s\n", i + 1 != head ? "," : "");
+	}
+	fprintf(f, "]}\n");
+
+	if (fclose(f))
+	{
+		xf86DrvMsg(trace->scrnIndex, X_ERROR, "[%s:%d] failed to write trace file %s\n", __FUNCTION__, __LINE__, trace->file);
+		return FALSE;
+	}
+
+	xf86DrvMsg(trace->scrnIndex, X_INFO, "Wrote %u trace events to %s\n", count, trace->file);
+
+	return TRUE;
+}
+
+Bool maliTraceInit( MaliTracePtr trace, int scrnIndex, unsigned int size, const char *file, Bool enable )
+{
+	memset(trace, 0, sizeof(*trace));
+	trace->scrnIndex = scrnIndex;
+	trace->size = size ? size : 1;
+	trace->file = file;
+	trace->signals = maliTraceSignals;
+
+	if (!RegisterBlockAndWakeupHandlers(maliTraceBlockHandler, maliTraceWakeupHandler, trace))
+	{
+		trace->size = 0;
+		return FALSE;
+	}
+
+	if (maliTraceUsers++ == 0)
+		maliTraceOldSignal = OsSignal(SIGUSR2, maliTraceSignal);
+
+	if (enable)
+		maliTraceEnable(trace);
+
+	return TRUE;
+}
+
+void maliTraceFini( MaliTracePtr trace )
+{
+	/* never initialised */
+	if (!trace->size)
+		return;
+
+	if (trace->enabled)
+	{
+		maliTraceDisable(trace);
+		maliTraceDump(trace);
+	}
+
+	RemoveBlockAndWakeupHandlers(maliTraceBlockHandler, maliTraceWakeupHandler, trace);
+
+	if (--maliTraceUsers == 0)
+		OsSignal(SIGUSR2, maliTraceOldSignal);
+
+	free(trace->records);
+	trace->records = NULL;
+	trace->size = 0;
+}
@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) ST-Ericsson SA 2011
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef _MALI_TRACE_H_
+#define _MALI_TRACE_H_
+
+#include "xf86.h"
+
+/* Default ring size in events, 24 bytes each */
+#define MALI_TRACE_EVENTS_DEFAULT 65536
+
+#define MALI_TRACE_FILE_DEFAULT "/var/log/mali_trace.json"
+
+typedef enum
+{
+	MALI_TRACE_BLT_SUBMIT,		/* job, pixels */
+	MALI_TRACE_BLT_WAIT,		/* job, duration */
+	MALI_TRACE_BLT_COMPLETE,	/* job, seen retired by the driver */
+	MALI_TRACE_HWMEM_ALLOC,		/* size, 1 if taken from the pool */
+	MALI_TRACE_HWMEM_FREE,		/* size, 1 if kept in the pool */
+	MALI_TRACE_DOMAIN_SYNC,		/* bytes, 1 towards the CPU, duration */
+	MALI_TRACE_DRI2_SWAP,		/* pixels, duration */
+	MALI_TRACE_DRI2_FLIP,		/* y offset, duration */
+	MALI_TRACE_XV_FRAME,		/* fourcc, pixels, duration */
+	MALI_TRACE_VBLANK,		/* msc, 1 if swaps are waiting */
+	MALI_TRACE_NUM_EVENTS
+} MaliTraceEvent;
+
+typedef struct
+{
+	CARD64 timestamp;	/* CLOCK_MONOTONIC ns */
+	CARD32 duration;	/* ns, 0 for instant events */
+	CARD32 event;
+	CARD32 arg0;
+	CARD32 arg1;
+} MaliTraceRecord;
+
+/*
+ * Ring of the most recent events of a screen. Writers claim slots with an
+ * atomic increment of head and never block, so recording is safe from any
+ * thread. Dumps run in the server thread after recording has stopped.
+ */
+typedef struct
+{
+	volatile int enabled;
+	MaliTraceRecord *records;
+	unsigned int mask;
+	volatile unsigned int head;
+
+	int scrnIndex;
+	unsigned int size;
+	const char *file;
+	unsigned int signals;
+} MaliTraceRec, *MaliTracePtr;
+
+#define MALI_TRACE_ON( trace ) ((trace) && (trace)->enabled)
+
+/* Start of a timed event, 0 when tracing is off */
+#define MALI_TRACE_BEGIN( trace ) (MALI_TRACE_ON(trace) ? maliTraceNow() : 0)
+
+#define MALI_TRACE_END( trace, event, start, arg0, arg1 ) \
+	do { if ((start) && MALI_TRACE_ON(trace)) maliTraceRecord(trace, event, start, arg0, arg1); } while (0)
+
+#define MALI_TRACE_INSTANT( trace, event, arg0, arg1 ) \
+	do { if (MALI_TRACE_ON(trace)) maliTraceRecord(trace, event, 0, arg0, arg1); } while (0)
+
+Bool maliTraceInit( MaliTracePtr trace, int scrnIndex, unsigned int size, const char *file, Bool enable );
+void maliTraceFini( MaliTracePtr trace );
+Bool maliTraceEnable( MaliTracePtr trace );
+void maliTraceDisable( MaliTracePtr trace );
+Bool maliTraceDump( MaliTracePtr trace );
+CARD64 maliTraceNow( void );
+void maliTraceRecord( MaliTracePtr trace, MaliTraceEvent event, CARD64 start, CARD32 arg0, CARD32 arg1 );
+
+#endif /* _MALI_TRACE_H_ */
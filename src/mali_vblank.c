@@ -0,0 +1,283 @@
+/*
+ * Copyright (C) ST-Ericsson SA 2011
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Vertical blanks for DRI2 swaps.
+ *
+ * A thread waits for the next vblank with FBIO_WAITFORVSYNC whenever the
+ * server has armed it, counts it and notes when it happened, and signals an
+ * eventfd the server watches along with its client sockets. The callback
+ * then runs from the wakeup handler of the server, so the main loop never
+ * blocks on the display.
+ *
+ * Between armed waits the thread sleeps. The count keeps going meanwhile:
+ * the vblanks missed are worked out from the refresh period of the mode when
+ * it wakes up again, and queries in between extrapolate the same way. The
+ * count never goes back, whatever the period estimate got wrong. A
+ * framebuffer without FBIO_WAITFORVSYNC gets vblanks timed from the clock.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <sys/select.h>
+
+#include "mali_vblank.h"
+
+static CARD64 maliVblankNow( void )
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (CARD64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Frame time of the mode, pixclock is in ps */
+static CARD64 maliVblankPeriod( const struct fb_var_screeninfo *var )
+{
+	CARD64 htotal = var->xres + var->left_margin + var->right_margin + var->hsync_len;
+	CARD64 vtotal = var->yres + var->upper_margin + var->lower_margin + var->vsync_len;
+	CARD64 period = (CARD64)var->pixclock * htotal * vtotal / 1000;
+
+	/* panels often leave the timings at 0, take anything outside 15 to 240 Hz as made up */
+	if (period < 1000000000 / 240 || period > 1000000000 / 15)
+		return MALI_VBLANK_PERIOD_DEFAULT;
+
+	return period;
+}
+
+static Bool maliVblankWaitHw( int fd )
+{
+	__u32 crtc = 0;
+
+	while (ioctl(fd, FBIO_WAITFORVSYNC, &crtc) < 0)
+	{
+		if (errno != EINTR)
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+/* Sleep until the vblank after the last one seen, as the refresh period has it */
+static void maliVblankWaitClock( MaliVblankPtr vbl )
+{
+	CARD64 now = maliVblankNow();
+	CARD64 next = vbl->ust + ((now - vbl->ust) / vbl->period + 1) * vbl->period;
+	struct timespec ts;
+
+	ts.tv_sec = next / 1000000000;
+	ts.tv_nsec = next % 1000000000;
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+		;
+}
+
+static void *maliVblankThread( void *data )
+{
+	MaliVblankPtr vbl = data;
+	uint64_t one = 1;
+
+	pthread_mutex_lock(&vbl->lock);
+	for (;;)
+	{
+		CARD64 now, frames;
+		Bool synthetic;
+
+		while (!vbl->stop && !vbl->armed)
+			pthread_cond_wait(&vbl->cond, &vbl->lock);
+		if (vbl->stop)
+			break;
+		vbl->armed = FALSE;
+		pthread_mutex_unlock(&vbl->lock);
+
+		/* only this thread writes ust and synthetic, reading them needs no lock here */
+		synthetic = vbl->synthetic || !maliVblankWaitHw(vbl->fd);
+		if (synthetic)
+			maliVblankWaitClock(vbl);
+		now = maliVblankNow();
+
+		pthread_mutex_lock(&vbl->lock);
+		vbl->synthetic = synthetic;
+		frames = (now - vbl->ust + vbl->period / 2) / vbl->period;
+		vbl->msc += frames ? frames : 1;
+		vbl->ust = now;
+		/* a query may have run ahead of the refresh rate, the count must not go back */
+		if (vbl->msc < vbl->queried)
+			vbl->msc = vbl->queried;
+		pthread_mutex_unlock(&vbl->lock);
+
+		(void)write(vbl->event_fd, &one, sizeof(one));
+
+		pthread_mutex_lock(&vbl->lock);
+	}
+	pthread_mutex_unlock(&vbl->lock);
+
+	return NULL;
+}
+
+static void maliVblankBlockHandler( pointer data, OSTimePtr pTimeout, pointer pReadmask )
+{
+}
+
+static void maliVblankWakeupHandler( pointer data, int result, pointer pReadmask )
+{
+	MaliVblankPtr vbl = data;
+	uint64_t count;
+	CARD64 msc, ust;
+	Bool synthetic;
+
+	if (result <= 0 || !FD_ISSET(vbl->event_fd, (fd_set *)pReadmask))
+		return;
+
+	if (read(vbl->event_fd, &count, sizeof(count)) != sizeof(count))
+		return;
+
+	pthread_mutex_lock(&vbl->lock);
+	msc = vbl->msc;
+	ust = vbl->ust;
+	synthetic = vbl->synthetic;
+	pthread_mutex_unlock(&vbl->lock);
+
+	if (synthetic && !vbl->warned)
+	{
+		xf86DrvMsg(vbl->scrnIndex, X_WARNING, "[%s:%d] FBIO_WAITFORVSYNC failed, timing vblanks from the refresh rate\n", __FUNCTION__, __LINE__);
+		vbl->warned = TRUE;
+	}
+
+	vbl->events++;
+	vbl->proc(vbl->data, msc, ust);
+}
+
+Bool maliVblankInit( MaliVblankPtr vbl, int scrnIndex, int fd, const struct fb_var_screeninfo *var, MaliVblankProcPtr proc, void *data )
+{
+	sigset_t all, saved;
+	int ret;
+
+	memset(vbl, 0, sizeof(*vbl));
+	vbl->scrnIndex = scrnIndex;
+	vbl->fd = fd;
+	vbl->proc = proc;
+	vbl->data = data;
+	vbl->period = maliVblankPeriod(var);
+	vbl->ust = maliVblankNow();
+	pthread_mutex_init(&vbl->lock, NULL);
+	pthread_cond_init(&vbl->cond, NULL);
+
+	vbl->event_fd = eventfd(0, EFD_NONBLOCK);
+	if (vbl->event_fd < 0)
+	{
+		xf86DrvMsg(scrnIndex, X_ERROR, "[%s:%d] failed to create the vblank eventfd\n", __FUNCTION__, __LINE__);
+		goto fail;
+	}
+
+	if (!RegisterBlockAndWakeupHandlers(maliVblankBlockHandler, maliVblankWakeupHandler, vbl))
+	{
+		xf86DrvMsg(scrnIndex, X_ERROR, "[%s:%d] failed to register the vblank wakeup handler\n", __FUNCTION__, __LINE__);
+		goto fail;
+	}
+	AddGeneralSocket(vbl->event_fd);
+
+	/* the thread inherits the mask, server signals stay with the server */
+	sigfillset(&all);
+	pthread_sigmask(SIG_BLOCK, &all, &saved);
+	ret = pthread_create(&vbl->thread, NULL, maliVblankThread, vbl);
+	pthread_sigmask(SIG_SETMASK, &saved, NULL);
+	if (ret != 0)
+	{
+		xf86DrvMsg(scrnIndex, X_ERROR, "[%s:%d] failed to start the vblank thread\n", __FUNCTION__, __LINE__);
+		RemoveGeneralSocket(vbl->event_fd);
+		RemoveBlockAndWakeupHandlers(maliVblankBlockHandler, maliVblankWakeupHandler, vbl);
+		goto fail;
+	}
+	vbl->running = TRUE;
+
+	xf86DrvMsg(scrnIndex, X_INFO, "Vblank period %llu us\n", (unsigned long long)(vbl->period / 1000));
+
+	return TRUE;
+
+fail:
+	if (vbl->event_fd >= 0)
+		close(vbl->event_fd);
+	vbl->event_fd = -1;
+	pthread_cond_destroy(&vbl->cond);
+	pthread_mutex_destroy(&vbl->lock);
+
+	return FALSE;
+}
+
+void maliVblankFini( MaliVblankPtr vbl )
+{
+	if (!vbl->running)
+		return;
+
+	pthread_mutex_lock(&vbl->lock);
+	vbl->stop = TRUE;
+	pthread_cond_signal(&vbl->cond);
+	pthread_mutex_unlock(&vbl->lock);
+	pthread_join(vbl->thread, NULL);
+	vbl->running = FALSE;
+
+	RemoveGeneralSocket(vbl->event_fd);
+	RemoveBlockAndWakeupHandlers(maliVblankBlockHandler, maliVblankWakeupHandler, vbl);
+	close(vbl->event_fd);
+	vbl->event_fd = -1;
+	pthread_cond_destroy(&vbl->cond);
+	pthread_mutex_destroy(&vbl->lock);
+}
+
+/* Have the callback run after the next vblank */
+void maliVblankArm( MaliVblankPtr vbl )
+{
+	pthread_mutex_lock(&vbl->lock);
+	if (!vbl->armed)
+	{
+		vbl->armed = TRUE;
+		pthread_cond_signal(&vbl->cond);
+	}
+	pthread_mutex_unlock(&vbl->lock);
+}
+
+/* The last vblank before now, extrapolated from the period while the thread sleeps */
+void maliVblankQuery( MaliVblankPtr vbl, CARD64 *msc, CARD64 *ust )
+{
+	CARD64 now = maliVblankNow();
+	CARD64 frames = 0;
+
+	pthread_mutex_lock(&vbl->lock);
+	if (now > vbl->ust)
+		frames = (now - vbl->ust) / vbl->period;
+	*msc = vbl->msc + frames;
+	*ust = vbl->ust + frames * vbl->period;
+	if (*msc > vbl->queried)
+		vbl->queried = *msc;
+	pthread_mutex_unlock(&vbl->lock);
+}
@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) ST-Ericsson SA 2011
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef _MALI_VBLANK_H_
+#define _MALI_VBLANK_H_
+
+#include <pthread.h>
+#include <linux/fb.h>
+#include "xf86.h"
+
+/* Refresh period assumed when the mode gives no pixel clock, 60 Hz */
+#define MALI_VBLANK_PERIOD_DEFAULT 16666667
+
+/* Run in the server from its wakeup handler, ust in CLOCK_MONOTONIC ns */
+typedef void (*MaliVblankProcPtr)( void *data, CARD64 msc, CARD64 ust );
+
+/*
+ * Vblank counter of a framebuffer. msc and ust are those of the last vblank
+ * the thread saw, written by the thread and read by the server under lock.
+ */
+typedef struct
+{
+	int scrnIndex;
+	int fd;
+	int event_fd;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	Bool running;
+	Bool stop;
+	Bool armed;
+	Bool synthetic;			/* no FBIO_WAITFORVSYNC, vblanks follow the clock */
+	Bool warned;
+	CARD64 period;			/* ns */
+	CARD64 msc;
+	CARD64 ust;
+	CARD64 queried;			/* highest msc a query handed out */
+	unsigned long events;
+
+	MaliVblankProcPtr proc;
+	void *data;
+} MaliVblankRec, *MaliVblankPtr;
+
+Bool maliVblankInit( MaliVblankPtr vbl, int scrnIndex, int fd, const struct fb_var_screeninfo *var, MaliVblankProcPtr proc, void *data );
+void maliVblankFini( MaliVblankPtr vbl );
+void maliVblankArm( MaliVblankPtr vbl );
+void maliVblankQuery( MaliVblankPtr vbl, CARD64 *msc, CARD64 *ust );
+
+#endif /* _MALI_VBLANK_H_ */
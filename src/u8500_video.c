@@ -70,7 +70,7 @@ typedef struct {
 	    img_width, img_height;
 
 	/*int fd_fb;*/
-	int blt_handle;
+	MaliBltPtr blt;		/* the video channel, shared by all ports */
 	int hwmem_fd;
 	int hwmem_size;
 	int buffer_handle;
@@ -111,6 +111,8 @@ static XF86ImageRec Images[] =
 static int
 U8500SetupPrivate(ScreenPtr screen, U8500PortPrivPtr pPriv)
 {
+	MaliPtr fPtr = MALIPTR(xf86Screens[screen->myNum]);
+
 	pPriv->hwmem_buffer_initialized = FALSE;
 	pPriv->color_key = -1;
 	pPriv->autopaint_colorkey = 0;
@@ -118,17 +120,16 @@ U8500SetupPrivate(ScreenPtr screen, U8500PortPrivPtr pPriv)
 	pPriv->hwmem_size = 0;
 	pPriv->buffer_handle = -1;
 	pPriv->vaddr = 0;
-	pPriv->hwmem_fd = (MALIPTR(xf86Screens[screen->myNum]))->hwmem_fd;
+	pPriv->hwmem_fd = fPtr->hwmem_fd;
 
 	REGION_INIT(screen, &pPriv->clip, NullBox, 0);
 
-	pPriv->blt_handle = blt_open();
-	if(pPriv->blt_handle < 0) {
+	pPriv->blt = maliExaVideoChannel();
+	if(!pPriv->blt) {
 		return -1;
 	}
 
 	if(pPriv->hwmem_fd < 0) {
-		blt_close(pPriv->blt_handle);
 		return -1;
 	}
 
@@ -137,8 +138,8 @@ U8500SetupPrivate(ScreenPtr screen, U8500PortPrivPtr pPriv)
 
 static void free_hwmem(U8500PortPrivPtr pPriv)
 {
-	munmap(pPriv->vaddr,pPriv->hwmem_size);
-	(void)ioctl(pPriv->hwmem_fd, HWMEM_RELEASE_IOC, pPriv->buffer_handle);
+	maliHwmemDevMunmap(pPriv->vaddr,pPriv->hwmem_size);
+	(void)maliHwmemDevIoctl(pPriv->hwmem_fd, HWMEM_RELEASE_IOC, pPriv->buffer_handle);
 	pPriv->vaddr = 0;
 }
 
@@ -149,7 +150,7 @@ static int alloc_hwmem(U8500PortPrivPtr pPriv, int size)
 	allocReq.flags = HWMEM_ALLOC_HINT_CACHED;
 	allocReq.default_access = HWMEM_ACCESS_READ | HWMEM_ACCESS_WRITE | HWMEM_ACCESS_IMPORT;
 	allocReq.mem_type = HWMEM_MEM_CONTIGUOUS_SYS;
-	pPriv->buffer_handle = ioctl(pPriv->hwmem_fd, HWMEM_ALLOC_IOC, &allocReq);
+	pPriv->buffer_handle = maliHwmemDevIoctl(pPriv->hwmem_fd, HWMEM_ALLOC_IOC, (unsigned long)&allocReq);
 	pPriv->hwmem_size = allocReq.size;
 
 	if (pPriv->buffer_handle < 0) {
@@ -157,10 +158,10 @@ static int alloc_hwmem(U8500PortPrivPtr pPriv, int size)
 		return -1;
 	}
 
-	pPriv->vaddr = mmap(NULL, pPriv->hwmem_size, PROT_READ | PROT_WRITE , MAP_SHARED, pPriv->hwmem_fd, pPriv->buffer_handle);
+	pPriv->vaddr = maliHwmemDevMmap(pPriv->hwmem_fd, pPriv->buffer_handle, pPriv->hwmem_size);
 	if (pPriv->vaddr == MAP_FAILED) {
 		ErrorF("Failed to mmap buffer %d\n", pPriv->buffer_handle);
-		(void)ioctl(pPriv->hwmem_fd, HWMEM_RELEASE_IOC, pPriv->buffer_handle);
+		(void)maliHwmemDevIoctl(pPriv->hwmem_fd, HWMEM_RELEASE_IOC, pPriv->buffer_handle);
 		return -1;
 	}
 
@@ -195,7 +196,6 @@ U8500overlayFreeAdaptor(MaliPtr fbdev, XF86VideoAdaptorPtr adapt)
 		for (i = 0; i < adapt->nPorts; i++) {
 			pPriv = adapt->pPortPrivates[i].ptr;
 			if (pPriv) {
-				blt_close(pPriv->blt_handle);
 				free_hwmem(pPriv);
 				pPriv->hwmem_fd = 0;
 			}
@@ -218,8 +218,11 @@ U8500overlayPutImage(ScrnInfoPtr screen, short src_x, short src_y,
 	st_yuvmb_frame_desc* Data = (st_yuvmb_frame_desc *) buf;
 	struct blt_req bltreq = {0};
 	PixmapPtr pPixmap;
-	MaliPtr fPtr;
+	MaliPtr fPtr = MALIPTR(screen);
+	CARD64 trace_start = MALI_TRACE_BEGIN(&fPtr->trace);
 	int copy_size = 0;
+	MaliBltJob job;
+	BoxRec box;
 
 	ENTER();
 
@@ -242,6 +245,11 @@ U8500overlayPutImage(ScrnInfoPtr screen, short src_x, short src_y,
 		pPixmap = pPriv->pDraw->pScreen->GetWindowPixmap((WindowPtr) pPriv->pDraw);
 	}
 
+	if (!maliPixmapEnsureHwmem(pPixmap)) {
+		LEAVE();
+		return BadAlloc;
+	}
+
 	PrivPixmap *privPixmap = (PrivPixmap *)exaGetPixmapDriverPrivate(pPixmap);
 
 	/*Check if resize, cropping and clipping settings changed.*/
@@ -309,6 +317,7 @@ U8500overlayPutImage(ScrnInfoPtr screen, short src_x, short src_y,
 			return 0;
 
 		pPriv->hwmem_buffer_initialized = TRUE;
+		fPtr->xv_buffer_allocs++;
 	}
 
 	bltreq.size = sizeof(struct blt_req);
@@ -367,27 +376,35 @@ U8500overlayPutImage(ScrnInfoPtr screen, short src_x, short src_y,
 	}
 
 	bltreq.global_alpha = 255;
-	bltreq.prio = 4;
 	bltreq.flags = BLT_FLAG_ASYNCH | BLT_FLAG_DESTINATION_CLIP;
 
 	if(pPriv->color_format != FOURCC_YUMB && pPriv->color_format != FOURCC_STE0)
 	{
 		bltreq.src_img.buf.type = BLT_PTR_HWMEM_BUF_NAME_OFFSET;
-		bltreq.src_img.buf.hwmem_buf_name = ioctl(pPriv->hwmem_fd, HWMEM_EXPORT_IOC, pPriv->buffer_handle);
+		bltreq.src_img.buf.hwmem_buf_name = maliHwmemDevIoctl(pPriv->hwmem_fd, HWMEM_EXPORT_IOC, pPriv->buffer_handle);
 		bltreq.src_img.buf.offset = 0;
 		memcpy((void *) pPriv->vaddr, (void *) buf, copy_size);
 	}
 
-	int status = blt_request(pPriv->blt_handle, &bltreq);
-	if(status < 0)
+	/* EXA blits into the same pixmap may still be pending */
+	maliPixmapWaitIdle(pPixmap);
+
+	job = maliBltSubmit(pPriv->blt, &bltreq, MALI_BLT_CLASS_XV);
+	if(!job)
 	{
-		ErrorF("Blit request failed: %d\n", status);
+		ErrorF("Blit request failed\n");
 		return 0;
 	}
 
-	(void)blt_synch(pPriv->blt_handle, status);
+	maliBltWait(pPriv->blt, job);
+
+	/* the CPU must not read what it has cached of the destination */
+	box.x1 = max(bltreq.dst_rect.x, bltreq.dst_clip_rect.x);
+	box.y1 = max(bltreq.dst_rect.y, bltreq.dst_clip_rect.y);
+	box.x2 = min(bltreq.dst_rect.x + bltreq.dst_rect.width, bltreq.dst_clip_rect.x + bltreq.dst_clip_rect.width);
+	box.y2 = min(bltreq.dst_rect.y + bltreq.dst_rect.height, bltreq.dst_clip_rect.y + bltreq.dst_clip_rect.height);
+	maliPixmapDeviceWrote(pPixmap, &box);
 
-	fPtr = MALIPTR(screen);
 	if (privPixmap->isFrameBuffer) {
 		fPtr->fb_lcd_var.yoffset = 0;
 		fPtr->fb_lcd_var.activate |= FB_ACTIVATE_FORCE;
@@ -399,6 +416,9 @@ U8500overlayPutImage(ScrnInfoPtr screen, short src_x, short src_y,
 
 	DamageDamageRegion(drawable, clip_boxes);
 
+	fPtr->xv_frames++;
+	MALI_TRACE_END(&fPtr->trace, MALI_TRACE_XV_FRAME, trace_start, id, dst_w * dst_h);
+
 	LEAVE();
 	return Success;
 }